@@ -26,14 +26,12 @@ void setup()
         .setAcceleration(50'000);
 
     // move two steppers simultaneously (not synchronized)
-    s1.moveAbsAsync(1000);
-    s2.moveAbsAsync(4000);
+    MoveToken m1 = s1.moveAbsAsync(1000);
+    MoveToken m2 = s2.moveAbsAsync(4000);
 
     // wait until both steppers are done
-    while (s1.isMoving || s2.isMoving)
-    {
-        delay(10);
-    }
+    m1.wait();
+    m2.wait();
     delay(100);
 
     // define and move a groups of steppers synchronized
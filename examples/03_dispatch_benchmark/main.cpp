@@ -0,0 +1,123 @@
+#include "Arduino.h"
+#include "teensystep4.h"
+
+using namespace TS4;
+
+// Cycles per step spent in the stepper ISRs, driven by a benchmark timer instead of a TMR channel.
+//  static: function pointer + context (ITimer::attachIsr) and non virtual updatePeriod, as used by the library
+//  legacy: same ISRs called through std::function callbacks plus a virtual float updateFrequency per step,
+//          i.e. the dispatch used before attachIsr was introduced
+// Runs on the Teensy (DWT cycle counter) or on an x86 Linux host (time stamp counter):
+//   g++ -std=gnu++14 -O2 -DTS4_HOST -Isrc/host -Isrc examples/03_dispatch_benchmark/main.cpp $(find src -name '*.cpp') -o dispatch_benchmark
+
+#if defined(TS4_HOST)
+#include <cstdio>
+#include <x86intrin.h>
+#define LOG printf
+static uint32_t cycles() { return (uint32_t)__rdtsc(); }
+#else
+#define LOG Serial.printf
+static uint32_t cycles() { return ARM_DWT_CYCCNT; }
+#endif
+
+class BenchTimer : public ITimer
+{
+ public:
+    void setPulseParams(float, unsigned) override {}
+    void start() override {}
+    void stop() override { running = false; }
+
+    uint32_t runStatic(unsigned steps)
+    {
+        uint32_t start = cycles();
+        for (unsigned i = 0; i < steps && running; i++)
+        {
+            stepIsr(context);
+            resetIsr(context);
+        }
+        return cycles() - start;
+    }
+
+    uint32_t runLegacy(unsigned steps)
+    {
+        isr_t s = stepIsr, r = resetIsr;
+        void* c = context;
+        callback_t stepCb([s, c] { s(c); });
+        callback_t resetCb([r, c] { r(c); });
+        ITimer* volatile self = this; // prevent devirtualization
+
+        uint32_t start = cycles();
+        for (unsigned i = 0; i < steps && running; i++)
+        {
+            stepCb();
+            self->updateFrequency((float)timerClock / period);
+            resetCb();
+        }
+        return cycles() - start;
+    }
+
+    bool running = true;
+};
+
+class BenchModule : public ITimerModule
+{
+ public:
+    ITimer* getChannel() override
+    {
+        timer.running = true;
+        return &timer;
+    }
+    void releaseChannel(ITimer*) override {}
+
+    BenchTimer timer;
+};
+
+BenchModule bench;
+Stepper stepper(0, 1);
+
+void measure(const char* engine)
+{
+    constexpr unsigned steps = 10'000;
+
+    stepper.setPosition(0);
+    stepper.moveAbsAsync(1'000'000); // accelerates during the whole measurement
+    uint32_t cStatic = bench.timer.runStatic(steps);
+    stepper.emergencyStop();
+
+    stepper.setPosition(0);
+    stepper.moveAbsAsync(1'000'000);
+    uint32_t cLegacy = bench.timer.runLegacy(steps);
+    stepper.emergencyStop();
+
+    LOG("%-8s static: %4u cycles/step   legacy: %4u cycles/step   (%.1f%% saved)\n",
+        engine, cStatic / steps, cLegacy / steps, 100.0f * (cLegacy - cStatic) / cLegacy);
+}
+
+void setup()
+{
+#if !defined(TS4_HOST)
+    while (!Serial) {}
+#endif
+
+    TS4::begin(false); // no TMR module, steppers get the benchmark timer
+    TimerFactory::attachModule(&bench);
+
+    stepper.setMaxSpeed(100'000).setAcceleration(10'000);
+
+    stepper.setRampEngine(Stepper::rampEngine_t::sqrt);
+    measure("sqrt");
+
+    stepper.setRampEngine(Stepper::rampEngine_t::integer);
+    measure("integer");
+}
+
+void loop()
+{
+}
+
+#if defined(TS4_HOST)
+int main()
+{
+    setup();
+}
+#endif
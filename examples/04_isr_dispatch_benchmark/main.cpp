@@ -0,0 +1,112 @@
+#include "Arduino.h"
+#include "teensystep4.h"
+#include "timers/Teensy4/TMR/TMR.h"
+
+using namespace TS4;
+
+// Cycles from entry of the TMR module ISR to the channel callbacks, 1..4 channels stepping at the same rate.
+//  pending: TMRModule::ISR, reads the compare flags of the channels in use once and services the set bits only
+//  polling: the ISR used before, tests the compare flag of all four channels and clears it read-modify-write
+
+class BenchModule : public TMRModule<0>
+{
+ public:
+    static void pendingISR()
+    {
+        entry = ARM_DWT_CYCCNT;
+        ISR();
+    }
+
+    static void pollingISR()
+    {
+        entry = ARM_DWT_CYCCNT;
+        for (unsigned ch = 0; ch < 4; ch++)
+        {
+            if (!(freeMask & (1u << ch)) && (regs->CH[ch].CSCTRL & TMR_CSCTRL_TCF1))
+            {
+                regs->CH[ch].CSCTRL &= ~TMR_CSCTRL_TCF1;
+                serviceChannel(ch);
+            }
+        }
+        asm volatile("dsb");
+    }
+
+    static volatile uint32_t entry;
+};
+volatile uint32_t BenchModule::entry;
+
+struct Probe
+{
+    uint32_t sum, max, count;
+};
+
+Probe probes[4];
+volatile bool measuring = false;
+
+void onEdge(void* ctx) // step and reset callback of the channels
+{
+    if (!measuring) return; // first step is called from start(), not from the ISR
+
+    uint32_t dt  = ARM_DWT_CYCCNT - BenchModule::entry;
+    Probe& probe = *static_cast<Probe*>(ctx);
+    probe.sum += dt;
+    probe.count++;
+    if (dt > probe.max) probe.max = dt;
+}
+
+BenchModule module;
+
+void measure(const char* name, void (*isr)(), unsigned nrChannels)
+{
+    attachInterruptVector(IRQ_QTIMER1, isr);
+
+    ITimer* timers[4];
+    for (unsigned i = 0; i < nrChannels; i++)
+    {
+        probes[i] = Probe{0, 0, 0};
+        timers[i] = module.getChannel();
+        timers[i]->attachIsr(onEdge, onEdge, &probes[i]);
+        timers[i]->setPulseParams(2, 0);
+        timers[i]->updatePeriod(timerClock / 20'000); // 20kHz, compare events of all channels coincide
+    }
+
+    noInterrupts();
+    for (unsigned i = 0; i < nrChannels; i++) timers[i]->start();
+    measuring = true;
+    interrupts();
+
+    delay(200);
+
+    measuring = false;
+    for (unsigned i = 0; i < nrChannels; i++)
+    {
+        timers[i]->stop();
+        module.releaseChannel(timers[i]);
+    }
+
+    uint32_t sum = 0, max = 0, count = 0;
+    for (unsigned i = 0; i < nrChannels; i++)
+    {
+        sum += probes[i].sum;
+        count += probes[i].count;
+        max = std::max(max, probes[i].max);
+    }
+    Serial.printf("%-8s %u channel(s): %4u cycles mean  %4u cycles max\n", name, nrChannels, sum / std::max(count, 1u), max);
+}
+
+void setup()
+{
+    while (!Serial) {}
+
+    TS4::begin(false); // the benchmark uses TMR1 directly
+
+    for (unsigned n = 1; n <= 4; n++)
+    {
+        measure("polling", BenchModule::pollingISR, n);
+        measure("pending", BenchModule::pendingISR, n);
+    }
+}
+
+void loop()
+{
+}
@@ -0,0 +1,68 @@
+#include "Arduino.h"
+#include "gcode.h"
+#include <cstring>
+
+using namespace TS4;
+
+// Lines per second of the G-code parser (tokenizing in place from the receive ring buffer)
+// Runs on the Teensy or on a Linux host:
+//   g++ -std=gnu++14 -O2 -DTS4_HOST -Isrc/host -Isrc examples/05_gcode_benchmark/main.cpp $(find src -name '*.cpp') -o gcode_benchmark
+
+#if defined(TS4_HOST)
+#include <chrono>
+#include <cstdio>
+#define LOG printf
+static double seconds() { return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+#else
+#define LOG Serial.printf
+static double seconds() { return micros() * 1e-6; }
+#endif
+
+GCodeParser parser;
+
+const char* program[] = {
+    "G1 X12.500 Y-3.25 Z0.2 F1800\n",
+    "X14.125 Y-1.5\n",
+    "N120 G1 X15.75 Y0.125 ; infill\n",
+    "G0 X0 Y0 Z5 (travel)\n",
+};
+constexpr unsigned nrLines = 1'000'000;
+
+void parse()
+{
+    GCodeLine line;
+    unsigned parsed = 0, written = 0;
+    double start = seconds();
+    while (parsed < nrLines)
+    {
+        for (; written < nrLines; written++) // whole lines as long as they fit, like a host counting the free characters
+        {
+            const char* text = program[written % 4];
+            unsigned n       = strlen(text);
+            if (parser.space() < n) break;
+            parser.write(text, n);
+        }
+        while (parser.next(line)) parsed++;
+    }
+    double t = seconds() - start;
+    LOG("parse: %8.0f lines/s  (%.2f us/line)\n", parsed / t, 1e6 * t / parsed);
+}
+
+void setup()
+{
+#if !defined(TS4_HOST)
+    while (!Serial) {}
+#endif
+    parse();
+}
+
+void loop()
+{
+}
+
+#if defined(TS4_HOST)
+int main()
+{
+    setup();
+}
+#endif
@@ -0,0 +1,53 @@
+#include "completion.h"
+#include "ringbuffer.h"
+
+namespace TS4
+{
+    namespace // private
+    {
+        // finished completions with a deferred callback, pushed by the step ISRs (all on the same priority level)
+        RingBuffer<Completion*, 32> deferredDone;
+    }
+
+    void Completion::setCallback(isr_t cb, void* ctx, bool _deferred)
+    {
+        noInterrupts();
+        callback = cb;
+        context  = ctx;
+        deferred = _deferred;
+        interrupts();
+    }
+
+    MoveToken Completion::begin(bool running)
+    {
+        started = started + 1;
+        if (!running) finished = started; // its finish() came first, the callback was already called
+        return MoveToken(&finished, started);
+    }
+
+    void Completion::advance()
+    {
+        if (finished != started) finished = finished + 1; // nothing outstanding: the popped move wasn't numbered yet
+    }
+
+    void Completion::finish()
+    {
+        finished = started;
+        if (callback == nullptr) return;
+
+        if (!deferred)
+            callback(context);
+        else if (!pending && deferredDone.push(this)) // already pending: one call covers both
+            pending = true;
+    }
+
+    void handleEvents()
+    {
+        Completion* c;
+        while (deferredDone.pop(c))
+        {
+            c->pending = false;
+            if (c->callback != nullptr) c->callback(c->context);
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Arduino.h"
+#include "timers/interfaces.h"
+#include <cstdint>
+
+namespace TS4
+{
+    /**
+     * Completion token of a move
+     * Moves of a stepper (or group) are numbered, a token is done when its move or a later one has ended
+     * (reached the target or stopped). A move started while another one runs takes over, the tokens of both
+     * are done when the stepper stops. done() is two loads and can be polled from anywhere, wait() yields
+     * until the move has ended. Default constructed tokens are done.
+     **/
+    class MoveToken
+    {
+     public:
+        MoveToken() = default;
+        MoveToken(const volatile uint32_t* finished, uint32_t id)
+            : finished(finished), id(id)
+        {}
+
+        bool done() const { return finished == nullptr || (int32_t)(*finished - id) >= 0; }
+        void wait() const
+        {
+            while (!done()) yield();
+        }
+
+     protected:
+        const volatile uint32_t* finished = nullptr;
+        uint32_t id                       = 0;
+    };
+
+    /**
+     * Move counters and done callback of a stepper or group
+     * begin() is called with interrupts disabled when a move was started or queued, finish() by the ISR when
+     * the stepper (group) stops. The callback runs in the ISR or, if deferred, from TS4::handleEvents().
+     **/
+    class Completion
+    {
+     public:
+        MoveToken begin(bool running = true); // running: false if the move ended before it was numbered
+        MoveToken last() const { return MoveToken(&finished, started); } // token of the latest started move
+
+        void advance(); // ISR: one queued move ended, the next one continues
+        void finish();  // ISR: all started moves ended
+
+        void setCallback(isr_t cb, void* ctx, bool deferred);
+
+     protected:
+        volatile uint32_t started  = 0;
+        volatile uint32_t finished = 0;
+
+        isr_t callback        = nullptr;
+        void* context         = nullptr;
+        bool deferred         = false;
+        volatile bool pending = false; // queued for handleEvents()
+
+        friend void handleEvents();
+    };
+
+    // runs the deferred done callbacks, call it from loop() (or any place where blocking is fine)
+    extern void handleEvents();
+}
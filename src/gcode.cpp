@@ -0,0 +1,268 @@
+#include "gcode.h"
+#include <cmath>
+
+namespace TS4
+{
+    namespace // private
+    {
+        constexpr char axisLetters[] = "XYZA";
+        constexpr float pow10[]      = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f};
+
+        int axisIndex(char letter)
+        {
+            for (int i = 0; i < TS4_GCODE_AXES && axisLetters[i] != 0; i++)
+            {
+                if (axisLetters[i] == letter) return i;
+            }
+            return -1;
+        }
+    }
+
+    // GCodeParser ==================================================================================
+
+    unsigned GCodeParser::write(const char* data, unsigned n)
+    {
+        unsigned i = 0;
+        while (i < n && rx.push(data[i])) i++;
+        return i;
+    }
+
+    bool GCodeParser::next(GCodeLine& line)
+    {
+        unsigned n   = rx.size();
+        unsigned end = scanned;
+        while (end < n && rx.at(end) != '\n') end++;
+
+        if (discarding) // rest of a line which didn't fit, already reported
+        {
+            if (end == n)
+            {
+                rx.drop(n);
+                scanned = 0;
+                return false;
+            }
+            rx.drop(end + 1);
+            scanned    = 0;
+            discarding = false;
+            n          = rx.size();
+            end        = 0;
+            while (end < n && rx.at(end) != '\n') end++;
+        }
+
+        line.axes     = 0;
+        line.motion   = -1;
+        line.distance = -1;
+        line.command  = -1;
+        line.hasF     = false;
+        line.hasP     = false;
+        line.error    = false;
+
+        if (end == n) // no complete line
+        {
+            if (n < rx.capacity())
+            {
+                scanned = n;
+                return false;
+            }
+            line.error = true; // the line doesn't fit into the buffer, skip it up to its end
+            rx.drop(n);
+            scanned    = 0;
+            discarding = true;
+            return true;
+        }
+
+        unsigned i = 0;
+        while (i < end && !line.error)
+        {
+            char c = rx.at(i++);
+            if (c == ' ' || c == '\t' || c == '\r') continue;
+            if (c == ';' || c == '*') break; // comment or checksum up to the line end
+            if (c == '(')
+            {
+                while (i < end && rx.at(i++) != ')') {}
+                continue;
+            }
+            if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+
+            // number of the word, parsed in place: sign, up to 9 significant digits, fraction
+            while (i < end && rx.at(i) == ' ') i++;
+            bool negative = i < end && rx.at(i) == '-';
+            if (i < end && (rx.at(i) == '-' || rx.at(i) == '+')) i++;
+            uint32_t mantissa = 0;
+            unsigned digits = 0, fraction = 0, scale = 0;
+            bool dot = false;
+            for (; i < end; i++)
+            {
+                char d = rx.at(i);
+                if (d == '.' && !dot)
+                {
+                    dot = true;
+                    continue;
+                }
+                if (d < '0' || d > '9') break;
+                digits++;
+                if (mantissa < 100'000'000 && fraction < 9) // further decimals are dropped
+                {
+                    mantissa = mantissa * 10 + (d - '0');
+                    if (dot) fraction++;
+                }
+                else if (!dot)
+                {
+                    scale++; // integer part beyond the precision
+                }
+            }
+            if (digits == 0 || scale > 9)
+            {
+                line.error = true;
+                break;
+            }
+            float value = mantissa * pow10[scale] / pow10[fraction];
+            if (negative) value = -value;
+
+            int axis = axisIndex(c);
+            if (axis >= 0)
+            {
+                line.axis[axis] = value;
+                line.axes |= 1 << axis;
+                continue;
+            }
+            switch (c)
+            {
+                case 'G':
+                    if (dot && value != (int)value)
+                        line.error = true; // G38.2 and friends
+                    else if (value == 0 || value == 1)
+                        line.motion = value;
+                    else if (value == 90 || value == 91)
+                        line.distance = value;
+                    else if (value == 4 || value == 92)
+                        line.command = value;
+                    else
+                        line.error = true;
+                    break;
+                case 'F':
+                    line.f    = value;
+                    line.hasF = true;
+                    break;
+                case 'P':
+                    line.p    = value;
+                    line.hasP = true;
+                    break;
+                case 'N': // line number
+                    break;
+                default:
+                    line.error = true;
+                    break;
+            }
+        }
+
+        rx.drop(end + 1);
+        scanned = 0;
+        return true;
+    }
+
+    // GCodeInterpreter =============================================================================
+
+    bool GCodeInterpreter::attachAxis(char letter, Stepper& stepper, float spu)
+    {
+        int i = axisIndex(letter >= 'a' && letter <= 'z' ? letter - ('a' - 'A') : letter);
+        if (i < 0 || spu <= 0) return false;
+
+        steppers[i]     = &stepper;
+        stepsPerUnit[i] = spu;
+        steps[i]        = stepper.getPosition();
+        position[i]     = steps[i] / spu;
+        return true;
+    }
+
+    unsigned GCodeInterpreter::poll(GCodeParser& parser)
+    {
+        unsigned executed = 0;
+        while (true)
+        {
+            if (!hasPending)
+            {
+                if (!parser.next(pending)) break;
+                hasPending = true;
+            }
+            if (!execute(pending)) break;
+
+            hasPending = false;
+            executed++;
+            if (reply != nullptr) reply(replyContext, !pending.error);
+        }
+        return executed;
+    }
+
+    bool GCodeInterpreter::execute(const GCodeLine& line)
+    {
+        if (line.error) return true;
+
+        // modal words, executing them again when the line has to wait is harmless
+        if (line.distance >= 0) relative = line.distance == 91;
+        if (line.hasF) feed = line.f;
+        if (line.motion >= 0) motion = line.motion;
+
+        if (line.command == 4) // dwell P seconds after the queued moves
+        {
+            if (!dwelling)
+            {
+                if (!group.lastMove().done()) return false;
+                dwelling   = true;
+                dwellStart = micros();
+                dwellUs    = line.hasP && line.p > 0 ? line.p * 1e6f : 0;
+            }
+            if (micros() - dwellStart < dwellUs) return false;
+            dwelling = false;
+            return true;
+        }
+
+        if (line.command == 92) // redefine the position of the given axes at standstill
+        {
+            if (!group.lastMove().done()) return false;
+            for (unsigned i = 0; i < TS4_GCODE_AXES; i++)
+            {
+                if (steppers[i] == nullptr || !(line.axes & (1 << i))) continue;
+                position[i] = line.axis[i];
+                steps[i]    = lroundf(position[i] * stepsPerUnit[i]);
+                steppers[i]->setPosition(steps[i]);
+                steppers[i]->setTargetAbs(steps[i]);
+            }
+            return true;
+        }
+
+        if (line.axes == 0) return true;
+
+        float target[TS4_GCODE_AXES];
+        int32_t targetSteps[TS4_GCODE_AXES];
+        float unitsSqr = 0, stepsSqr = 0;
+        for (unsigned i = 0; i < TS4_GCODE_AXES; i++)
+        {
+            if (steppers[i] == nullptr) continue;
+            target[i] = position[i];
+            if (line.axes & (1 << i)) target[i] = relative ? position[i] + line.axis[i] : line.axis[i];
+            targetSteps[i] = lroundf(target[i] * stepsPerUnit[i]);
+
+            float du = target[i] - position[i], ds = targetSteps[i] - steps[i];
+            unitsSqr += du * du;
+            stepsSqr += ds * ds;
+        }
+        if (stepsSqr == 0) return true;
+
+        // F along the path in units, the planner limits the path in steps
+        group.setFeedRate(motion == 0 || feed <= 0 || unitsSqr == 0 ? 0 : feed / 60 * sqrtf(stepsSqr / unitsSqr));
+        for (unsigned i = 0; i < TS4_GCODE_AXES; i++)
+        {
+            if (steppers[i] != nullptr) steppers[i]->setTargetAbs(targetSteps[i]);
+        }
+        if (!group.queueMove()) return false;
+
+        for (unsigned i = 0; i < TS4_GCODE_AXES; i++)
+        {
+            if (steppers[i] == nullptr) continue;
+            position[i] = target[i];
+            steps[i]    = targetSteps[i];
+        }
+        return true;
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "ringbuffer.h"
+#include "steppergroup.h"
+#include <cstdint>
+
+#if !defined(TS4_GCODE_BUFFER)
+#define TS4_GCODE_BUFFER 1024 // characters received but not yet parsed, power of 2
+#endif
+
+#if !defined(TS4_GCODE_AXES)
+#define TS4_GCODE_AXES 4 // axis words X, Y, Z, A
+#endif
+
+namespace TS4
+{
+    struct GCodeLine // words of one line
+    {
+        float axis[TS4_GCODE_AXES]; // valid if the bit of the axis is set in axes
+        float f, p;
+        uint8_t axes;     // bit mask of the axis words present
+        int8_t motion;    // 0, 1: G0/G1, -1: none
+        int8_t distance;  // 90, 91: G90/G91, -1: none
+        int8_t command;   // non modal: 4 (G4 dwell), 92 (G92 set position), -1: none
+        bool hasF, hasP;
+        bool error;       // malformed or unsupported word, the line is not executed
+    };
+
+    /**
+     * G-code tokenizer
+     * The serial RX path writes characters into a lock free ring buffer, next() parses complete lines in place
+     * (no copy, no heap) and removes them. Supported words: G0, G1, G4, G90, G91, G92, X Y Z A F P, N and
+     * checksums are skipped, comments in parentheses or after ';' are ignored.
+     **/
+    class GCodeParser
+    {
+     public:
+        bool write(char c) { return rx.push(c); } // producer (RX ISR or main loop), false if the buffer is full
+        unsigned write(const char* data, unsigned n); // returns the number of characters taken
+        unsigned space() const { return rx.capacity() - rx.size(); } // free characters, for flow control of the host
+
+        bool next(GCodeLine& line); // false if no complete line was received, a line longer than the buffer is an error
+
+     protected:
+        RingBuffer<char, TS4_GCODE_BUFFER> rx;
+        unsigned scanned = 0;      // characters in front already searched for the line end
+        bool discarding  = false; // skipping the rest of a line longer than the buffer
+    };
+
+    /**
+     * Executes parsed lines on a StepperGroup
+     * Moves go to the look-ahead queue of the group, poll() returns as soon as a line has to wait (queue full,
+     * dwell, G92 waits for standstill) and continues with it on the next call, the main loop never blocks.
+     * Units are converted by the steps per unit of each axis, F is in units/min along the path of the attached axes.
+     **/
+    class GCodeInterpreter
+    {
+     public:
+        using reply_t = void (*)(void* ctx, bool ok); // called for every executed line, e.g. to send "ok" to the host
+
+        GCodeInterpreter(StepperGroup& group) : group(group) {}
+
+        bool attachAxis(char letter, Stepper& stepper, float stepsPerUnit); // stepper must be a member of the group
+        void onLine(reply_t cb, void* ctx = nullptr)
+        {
+            reply        = cb;
+            replyContext = ctx;
+        }
+
+        unsigned poll(GCodeParser& parser); // executes received lines until one has to wait, returns the number executed
+        bool execute(const GCodeLine& line); // false: not yet possible, call again with the same line
+
+     protected:
+        StepperGroup& group;
+        Stepper* steppers[TS4_GCODE_AXES] = {};
+        float stepsPerUnit[TS4_GCODE_AXES];
+        float position[TS4_GCODE_AXES] = {}; // programmed position (units)
+        int32_t steps[TS4_GCODE_AXES]  = {}; // programmed position (steps)
+
+        int8_t motion = 0;
+        bool relative = false;
+        float feed    = 0; // units/min
+
+        bool dwelling       = false;
+        uint32_t dwellStart = 0, dwellUs = 0;
+
+        GCodeLine pending;
+        bool hasPending = false;
+
+        reply_t reply      = nullptr;
+        void* replyContext = nullptr;
+    };
+}
@@ -0,0 +1,123 @@
+#include "Arduino.h"
+
+#pragma push_macro("abs")
+#undef abs
+
+#include "gearing.h"
+#include "stepperbase.h"
+
+namespace TS4
+{
+    bool Gearing::attach(StepperBase& _master)
+    {
+        if (_master.isMoving || _master.player != nullptr) return false;
+
+        detach();
+        noInterrupts();
+        master        = &_master;
+        master->gears = this;
+        interrupts();
+        setDirection(master->dirLevel == LOW ? -1 : 1);
+        return true;
+    }
+
+    void Gearing::detach()
+    {
+        if (master == nullptr) return;
+
+        noInterrupts();
+        master->gears = nullptr;
+        master        = nullptr;
+        interrupts();
+    }
+
+    bool Gearing::addFollower(StepperBase& follower, int32_t num, int32_t den, int32_t phase)
+    {
+        if (nrFollowers >= TS4_MAX_FOLLOWERS || den <= 0 || std::abs(num) > den || find(follower) != nullptr) return false;
+
+        GearAxis axis;
+        axis.stepper = &follower;
+        axis.pos     = &follower.pos;
+        axis.events  = &follower.events;
+        axis.num     = num;
+        axis.den     = den;
+        axis.acc     = constrain(phase, -den + 1, den - 1);
+#if defined(TS4_HOST)
+        axis.pin = follower.stepPin;
+#else
+        axis.setReg   = portSetRegister(follower.stepPin);
+        axis.clearReg = portClearRegister(follower.stepPin);
+        axis.mask     = digitalPinToBitMask(follower.stepPin);
+#endif
+        noInterrupts();
+        axis.inc = num * masterDir;
+        bool changed = updateDir(axis);
+        axes[nrFollowers] = axis;
+        nrFollowers++;
+        if (changed && master != nullptr) master->dirSetup = true; // the next master step waits for the setup time
+        interrupts();
+        return true;
+    }
+
+    bool Gearing::setRatio(StepperBase& follower, int32_t num, int32_t den)
+    {
+        if (den <= 0 || std::abs(num) > den) return false;
+
+        noInterrupts();
+        GearAxis* axis = find(follower);
+        if (axis != nullptr)
+        {
+            axis->acc = (int64_t)axis->acc * den / axis->den; // same fraction of a step
+            axis->num = num;
+            axis->den = den;
+            axis->inc = num * masterDir;
+            if (updateDir(*axis) && master != nullptr) master->dirSetup = true;
+        }
+        interrupts();
+        return axis != nullptr;
+    }
+
+    void Gearing::removeFollower(StepperBase& follower)
+    {
+        noInterrupts();
+        GearAxis* axis = find(follower);
+        if (axis != nullptr)
+        {
+            unsigned i = axis - axes;
+            if (pulse & (1u << i)) digitalWriteFast(follower.stepPin, LOW);
+            pulse = (pulse & ((1u << i) - 1)) | ((pulse >> (i + 1)) << i); // keep the bits of the others in place
+            std::copy(axes + i + 1, axes + nrFollowers, axes + i);
+            nrFollowers--;
+        }
+        interrupts();
+    }
+
+    bool Gearing::setDirection(int32_t _masterDir)
+    {
+        masterDir    = _masterDir;
+        bool changed = false;
+        for (unsigned i = 0; i < nrFollowers; i++)
+        {
+            axes[i].inc = axes[i].num * masterDir;
+            changed |= updateDir(axes[i]);
+        }
+        return changed;
+    }
+
+    GearAxis* Gearing::find(StepperBase& follower)
+    {
+        for (unsigned i = 0; i < nrFollowers; i++)
+        {
+            if (axes[i].stepper == &follower) return &axes[i];
+        }
+        return nullptr;
+    }
+
+    bool Gearing::updateDir(GearAxis& axis)
+    {
+        axis.dir = signum(axis.inc);
+        return axis.dir != 0 && axis.stepper->setDir(axis.dir);
+    }
+}
+
+#pragma pop_macro("abs")
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "Arduino.h"
+#include "posevents.h"
+#include <cstdint>
+
+#if !defined(TS4_MAX_FOLLOWERS)
+#define TS4_MAX_FOLLOWERS 4 // followers per gearing
+#endif
+
+namespace TS4
+{
+    class StepperBase;
+
+    struct GearAxis // accumulator of a follower, the signed variant of the Bresenham state in SlaveAxis
+    {
+        StepperBase* stepper;
+        volatile int32_t* pos;
+        PositionEvents* events;
+        int32_t num, den; // ratio, |num| <= den
+        int32_t inc;      // num · direction of the master
+        int32_t acc;      // follower steps · den - num · master steps, kept within (-den, den)
+        int32_t dir;
+#if defined(TS4_HOST)
+        uint8_t pin;
+#else
+        volatile uint32_t* setReg;
+        volatile uint32_t* clearReg;
+        uint32_t mask;
+#endif
+    };
+
+    /**
+     * Electronic gearing, followers locked to the steps of a master
+     * Every master step adds num·dir to the accumulator of each follower, the follower steps whenever it
+     * crosses ±den. The accumulator keeps the fraction, so the followers track ratio·(master steps) without
+     * drift and reverse together with the master. Followers can't be faster than the master (|num| <= den).
+     * An attached master stepper runs step() and reset() from its step ISRs. Any other step source (e.g. an
+     * encoder ISR) can drive a gearing directly: setDirection() before the first step in a new direction
+     * (the source is responsible for the driver setup time), then step() per count and reset() after the
+     * pulse width. Followers must not be moved otherwise while they are geared.
+     **/
+    class Gearing
+    {
+     public:
+        ~Gearing() { detach(); }
+
+        bool attach(StepperBase& master); // false if the master is moving (its timer might drive the step pin)
+        void detach();
+
+        bool addFollower(StepperBase& follower, int32_t num, int32_t den, int32_t phase = 0); // phase: initial accumulator (1/den steps)
+        bool setRatio(StepperBase& follower, int32_t num, int32_t den);                         // on the fly, keeps the phase
+        void removeFollower(StepperBase& follower);
+        unsigned followers() const { return nrFollowers; }
+
+        bool setDirection(int32_t masterDir); // writes the dir pins of the followers, true if one changed
+        inline void step();                   // one master step
+        inline void reset();                  // clears the step pins set by step()
+
+     protected:
+        GearAxis* find(StepperBase& follower);
+        bool updateDir(GearAxis& axis); // from inc, true if the dir pin changed
+
+        GearAxis axes[TS4_MAX_FOLLOWERS];
+        unsigned nrFollowers = 0;
+        int32_t masterDir    = 1;
+        StepperBase* master  = nullptr;
+        uint32_t pulse       = 0; // followers stepped by the last step()
+    };
+
+    // inline implementation ===========================================================
+
+    void Gearing::step()
+    {
+        for (unsigned i = 0; i < nrFollowers; i++)
+        {
+            GearAxis& axis = axes[i];
+            axis.acc += axis.inc;
+            if (axis.acc >= axis.den || axis.acc <= -axis.den)
+            {
+                axis.acc -= axis.dir * axis.den;
+                *axis.pos += axis.dir;
+#if defined(TS4_HOST)
+                digitalWriteFast(axis.pin, HIGH);
+#else
+                *axis.setReg = axis.mask;
+#endif
+                pulse |= 1u << i;
+                axis.events->stepped(axis.dir);
+            }
+        }
+    }
+
+    void Gearing::reset()
+    {
+        while (pulse != 0)
+        {
+            GearAxis& axis = axes[__builtin_ctz(pulse)];
+#if defined(TS4_HOST)
+            digitalWriteFast(axis.pin, LOW);
+#else
+            *axis.clearReg = axis.mask;
+#endif
+            pulse &= pulse - 1;
+        }
+    }
+}
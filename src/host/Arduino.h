@@ -0,0 +1,37 @@
+#pragma once
+
+// Minimal Arduino API to run the TeensyStep4 motion core on a host (build with -DTS4_HOST -Isrc/host).
+// Time is the virtual clock of TS4::SimClock, pin writes are recorded by TS4::SimTrace.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define LED_BUILTIN 13
+
+#define PI 3.1415926535897932384626433832795
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+uint8_t digitalRead(uint8_t pin);
+
+volatile uint32_t* portConfigRegister(uint8_t pin); // pin mux register, plain memory on the host
+
+inline void digitalWriteFast(uint8_t pin, uint8_t val) { digitalWrite(pin, val); }
+inline uint8_t digitalReadFast(uint8_t pin) { return digitalRead(pin); }
+inline void digitalToggleFast(uint8_t pin) { digitalWrite(pin, !digitalRead(pin)); }
+
+uint32_t micros();
+uint32_t millis();
+void delay(uint32_t ms);              // runs the simulation for ms
+void delayMicroseconds(uint32_t us); // runs the simulation for us, no-op inside a simulated ISR
+void yield();                        // runs the simulation for 1µs
+
+inline void noInterrupts() {}
+inline void interrupts() {}
@@ -0,0 +1,52 @@
+#if defined(TS4_HOST)
+
+#include "Arduino.h"
+#include "../timers/Sim/SimTimer.h"
+
+using TS4::SimClock;
+using TS4::SimTrace;
+
+namespace
+{
+    uint8_t levels[SimTrace::maxPins];
+    uint32_t muxRegs[SimTrace::maxPins];
+}
+
+void pinMode(uint8_t /*pin*/, uint8_t /*mode*/) {}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    if (pin >= SimTrace::maxPins) return;
+    levels[pin] = val != LOW;
+    SimTrace::record(pin, val != LOW);
+}
+
+uint8_t digitalRead(uint8_t pin)
+{
+    return pin < SimTrace::maxPins ? levels[pin] : LOW;
+}
+
+volatile uint32_t* portConfigRegister(uint8_t pin)
+{
+    return &muxRegs[pin < SimTrace::maxPins ? pin : 0];
+}
+
+uint32_t micros() { return SimClock::now() / 1'000; }
+uint32_t millis() { return SimClock::now() / 1'000'000; }
+
+void delay(uint32_t ms)
+{
+    if (!SimClock::inISR()) SimClock::run(ms * 1'000'000ull);
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    if (!SimClock::inISR()) SimClock::run(us * 1'000ull);
+}
+
+void yield()
+{
+    if (!SimClock::inISR()) SimClock::run(1'000);
+}
+
+#endif
@@ -0,0 +1,81 @@
+#pragma once
+
+// Register-level fake of the i.MX RT1062 QuadTimer (host builds only).
+// Same layout and bit definitions as the Teensy core, registers are plain memory:
+// tests construct channels on fake register blocks and inspect what the drivers write.
+
+#include <cstdint>
+
+typedef struct
+{
+    volatile uint16_t COMP1;
+    volatile uint16_t COMP2;
+    volatile uint16_t CAPT;
+    volatile uint16_t LOAD;
+    volatile uint16_t HOLD;
+    volatile uint16_t CNTR;
+    volatile uint16_t CTRL;
+    volatile uint16_t SCTRL;
+    volatile uint16_t CMPLD1;
+    volatile uint16_t CMPLD2;
+    volatile uint16_t CSCTRL;
+    volatile uint16_t FILT;
+    volatile uint16_t DMA;
+    volatile uint16_t unused1[2];
+    volatile uint16_t ENBL;
+} IMXRT_TMR_CH_t;
+
+typedef struct
+{
+    IMXRT_TMR_CH_t CH[4];
+} IMXRT_TMR_t;
+
+#define IMXRT_TMR1_ADDRESS 0x401DC000
+#define IMXRT_TMR2_ADDRESS 0x401E0000
+#define IMXRT_TMR3_ADDRESS 0x401E4000
+#define IMXRT_TMR4_ADDRESS 0x401E8000
+
+enum IRQ_NUMBER_t { IRQ_QTIMER1 = 133, IRQ_QTIMER2 = 134, IRQ_QTIMER3 = 135, IRQ_QTIMER4 = 136 };
+inline void attachInterruptVector(IRQ_NUMBER_t, void (*)()) {}
+#define NVIC_ENABLE_IRQ(n)
+#define NVIC_DISABLE_IRQ(n)
+
+#define TMR_CTRL_CM(n)        ((uint16_t)(((n) & 0x07) << 13))
+#define TMR_CTRL_PCS(n)       ((uint16_t)(((n) & 0x0F) << 9))
+#define TMR_CTRL_SCS(n)       ((uint16_t)(((n) & 0x03) << 7))
+#define TMR_CTRL_ONCE         ((uint16_t)(1 << 6))
+#define TMR_CTRL_LENGTH       ((uint16_t)(1 << 5))
+#define TMR_CTRL_DIR          ((uint16_t)(1 << 4))
+#define TMR_CTRL_COINIT       ((uint16_t)(1 << 3))
+#define TMR_CTRL_OUTMODE(n)   ((uint16_t)(((n) & 0x07) << 0))
+
+#define TMR_SCTRL_TCF         ((uint16_t)(1 << 15))
+#define TMR_SCTRL_TCFIE       ((uint16_t)(1 << 14))
+#define TMR_SCTRL_TOF         ((uint16_t)(1 << 13))
+#define TMR_SCTRL_TOFIE       ((uint16_t)(1 << 12))
+#define TMR_SCTRL_IEF         ((uint16_t)(1 << 11))
+#define TMR_SCTRL_IEFIE       ((uint16_t)(1 << 10))
+#define TMR_SCTRL_IPS         ((uint16_t)(1 << 9))
+#define TMR_SCTRL_INPUT       ((uint16_t)(1 << 8))
+#define TMR_SCTRL_MSTR        ((uint16_t)(1 << 5))
+#define TMR_SCTRL_EEOF        ((uint16_t)(1 << 4))
+#define TMR_SCTRL_VAL         ((uint16_t)(1 << 3))
+#define TMR_SCTRL_FORCE       ((uint16_t)(1 << 2))
+#define TMR_SCTRL_OPS         ((uint16_t)(1 << 1))
+#define TMR_SCTRL_OEN         ((uint16_t)(1 << 0))
+
+#define TMR_CSCTRL_ALT_LOAD   ((uint16_t)(1 << 12))
+#define TMR_CSCTRL_ROC        ((uint16_t)(1 << 11))
+#define TMR_CSCTRL_TCI        ((uint16_t)(1 << 10))
+#define TMR_CSCTRL_UP         ((uint16_t)(1 << 9))
+#define TMR_CSCTRL_OFLAG      ((uint16_t)(1 << 8))
+#define TMR_CSCTRL_TCF2EN     ((uint16_t)(1 << 7))
+#define TMR_CSCTRL_TCF1EN     ((uint16_t)(1 << 6))
+#define TMR_CSCTRL_TCF2       ((uint16_t)(1 << 5))
+#define TMR_CSCTRL_TCF1       ((uint16_t)(1 << 4))
+#define TMR_CSCTRL_CL2(n)     ((uint16_t)(((n) & 0x03) << 2))
+#define TMR_CSCTRL_CL1(n)     ((uint16_t)(((n) & 0x03) << 0))
+
+#define TMR_DMA_CMPLD2DE      ((uint16_t)(1 << 2))
+#define TMR_DMA_CMPLD1DE      ((uint16_t)(1 << 1))
+#define TMR_DMA_IEFDE         ((uint16_t)(1 << 0))
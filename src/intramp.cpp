@@ -0,0 +1,52 @@
+#include "intramp.h"
+#include "timers/interfaces.h"
+#include <algorithm>
+#include <cmath>
+
+namespace TS4
+{
+    const uint32_t IntRamp::upRatio[mExact]{0, 0, 46341, 53510, 56756, 58617, 59826, 60675, 61303, 61788, 62173, 62486, 62746, 62965, 63152, 63314};
+    const uint32_t IntRamp::dnRatio[mExact]{0, 0, 92682, 80265, 75674, 73271, 71791, 70787, 70061, 69511, 69081, 68735, 68450, 68212, 68010, 67836};
+
+    void IntRamp::start(int64_t v_sqr, int32_t _twoA, uint32_t v_tgt)
+    {
+        twoA = _twoA;
+        rest = 0;
+        m    = std::max<int64_t>(1, v_sqr / twoA);
+
+        if (table != nullptr && 2 * table->acc != (uint32_t)twoA) // acceleration changed, table no longer valid
+        {
+            RampCache::release(table);
+            useTable(nullptr);
+        }
+
+        setTarget(v_tgt);
+        period = m <= tblEnd ? tblPeriods[m] : timerClock / sqrtf((float)m * twoA);
+        frac   = m == mTgt ? pTgtFrac : 0;
+        if (m == mTgt) period = pTgt;
+    }
+
+    void IntRamp::useTable(RampTable* t)
+    {
+        table      = t;
+        tblPeriods = t != nullptr ? t->periods : nullptr;
+        tblEnd     = t != nullptr ? t->mMax : 0;
+    }
+
+    void IntRamp::setTarget(uint32_t v_tgt)
+    {
+        mTgt     = ((int64_t)v_tgt * v_tgt) / twoA;
+        pTgt     = v_tgt > 0 ? timerClock / v_tgt : UINT32_MAX;
+        pTgtFrac = v_tgt > 0 ? ((uint64_t)(timerClock % v_tgt) << 16) / v_tgt : 0;
+        setExit(0);
+    }
+
+    void IntRamp::setExit(int64_t v_sqr)
+    {
+        mMin = std::max<int64_t>(1, vStartSqr / twoA);
+        if (mTgt > 0 && mTgt < mMin) mMin = mTgt; // target slower than start speed
+
+        int64_t mExit = std::min<int64_t>(v_sqr / twoA, mTgt); // junction speed of chained moves
+        if (mExit > mMin) mMin = mExit;
+    }
+}
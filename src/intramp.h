@@ -0,0 +1,121 @@
+#pragma once
+
+#include "ramptable.h"
+#include <cstdint>
+
+namespace TS4
+{
+    /**
+     * Integer step period ramp
+     * Tracks the constant acceleration profile v² = v0² + 2a·s directly in step periods
+     * (ticks of TS4::timerClock). The ramp index m encodes the current speed as v² = 2a·m,
+     * stepping up or down the ramp is a single integer division (period recurrence)
+     * instead of a sqrt and a float division per step.
+     *
+     * Accuracy: the per-step period stays within 0.3% of the exact profile (dominated by
+     * the one tick quantization at top speed), the accumulated ramp time within 0.1%.
+     *
+     * If a matching RampTable is attached, periods for indices covered by the table are
+     * looked up instead of computed.
+     **/
+    class IntRamp
+    {
+     public:
+        void start(int64_t v_sqr, int32_t twoA, uint32_t v_tgt); // seed from current speed (one sqrt, not ISR critical)
+        void setTarget(uint32_t v_tgt);                          // change target speed, keeps current speed
+        void setExit(int64_t v_sqr);                             // decelerate() stops at this speed instead of the start speed
+        void useTable(RampTable* table);                         // nullptr: compute all periods
+
+        inline void accelerate(); // one step up the ramp, stops at the target speed
+        inline void decelerate(); // one step down the ramp, stops at the start speed
+        inline void approach();   // one step towards the target speed
+
+        int64_t vSqr() const { return (int64_t)m * twoA; }
+
+        RampTable* table = nullptr;
+
+        uint32_t period;   // current step period (timer ticks)
+        uint16_t frac = 0; // fraction of the period (1/65536 ticks), only set at the target speed
+        int32_t m;       // ramp index, v² = 2a·m
+        int32_t mTgt;    // ramp index of the target speed
+        int32_t mMin;    // ramp index of the start/stop speed (or of a lower target speed)
+
+     protected:
+        int32_t twoA;
+        uint32_t pTgt;     // exact period at target speed, avoids drift while cruising
+        uint16_t pTgtFrac; // remainder of timerClock / v_tgt, the timer accumulates it
+        int32_t rest;  // remainder of the period recurrence
+
+        const uint32_t* tblPeriods;
+        int32_t tblEnd = 0; // last index covered by the table
+
+        static constexpr int64_t vStartSqr = 200 * 200; // start/stop speed, same as the sqrt engine
+
+        // exact ratios sqrt((m-1)/m) and sqrt(m/(m-1)) (Q16) for the first steps where the recurrence is inaccurate
+        static constexpr int32_t mExact = 16;
+        static const uint32_t upRatio[mExact];
+        static const uint32_t dnRatio[mExact];
+    };
+
+    // inline implementation ===========================================================
+
+    void IntRamp::accelerate()
+    {
+        if (m >= mTgt) return;
+        m++;
+        if (m <= tblEnd)
+        {
+            period = tblPeriods[m];
+            rest   = 0;
+        }
+        else if (m < mExact)
+        {
+            period = ((uint64_t)period * upRatio[m]) >> 16;
+            rest   = 0;
+        }
+        else // c(m) = c(m-1) * (4m-3)/(4m-1)
+        {
+            int32_t d   = 4 * m - 1;
+            int32_t num = 2 * period + rest;
+            int32_t q   = num / d;
+            rest        = num - q * d;
+            period -= q;
+        }
+        frac = m == mTgt ? pTgtFrac : 0;
+        if (m == mTgt) period = pTgt;
+    }
+
+    void IntRamp::decelerate()
+    {
+        if (m <= mMin) return;
+        if (m - 1 <= tblEnd)
+        {
+            period = tblPeriods[m - 1];
+            rest   = 0;
+        }
+        else if (m < mExact)
+        {
+            period = ((uint64_t)period * dnRatio[m]) >> 16;
+            rest   = 0;
+        }
+        else // c(m-1) = c(m) * (4m-1)/(4m-3)
+        {
+            int32_t d   = 4 * m - 3;
+            int32_t num = 2 * period + rest;
+            int32_t q   = num / d;
+            rest        = num - q * d;
+            period += q;
+        }
+        m--;
+        frac = m == mTgt ? pTgtFrac : 0;
+        if (m == mTgt) period = pTgt;
+    }
+
+    void IntRamp::approach()
+    {
+        if (m < mTgt)
+            accelerate();
+        else if (m > mTgt)
+            decelerate();
+    }
+}
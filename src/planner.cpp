@@ -0,0 +1,225 @@
+#include "Arduino.h"
+
+#pragma push_macro("abs")
+#undef abs
+
+#include "planner.h"
+#include <algorithm>
+#include <cmath>
+
+namespace TS4
+{
+    void PathPlanner::reset(const int32_t* pos, unsigned n)
+    {
+        axes = std::min<unsigned>(n, TS4_MAX_GROUP_SIZE);
+        for (unsigned i = 0; i < axes; i++)
+        {
+            last[i]     = pos[i];
+            lastUnit[i] = 0;
+        }
+        hasLast  = false; // path starts from standstill
+        lastLead = 0;
+    }
+
+    bool PathPlanner::add(const int32_t* target, const uint32_t* vMax, const uint32_t* acc)
+    {
+        PathBlock b;
+        float lengthSqr = 0;
+        unsigned lead   = lastLead; // keep the current lead if deltas are equal
+        for (unsigned i = 0; i < axes; i++)
+        {
+            int32_t d   = target[i] - last[i];
+            b.target[i] = target[i];
+            lengthSqr += (float)d * d;
+            if (std::abs(d) > std::abs(target[lead] - last[lead])) lead = i;
+        }
+        if (lengthSqr == 0) return true; // nothing to do
+
+        b.length    = sqrtf(lengthSqr);
+        b.lead      = lead;
+        b.leadRatio = std::abs(target[lead] - last[lead]) / b.length;
+        b.rSqr      = 0;
+        b.endsMove  = true;
+        b.vMax      = INFINITY;
+        b.acc       = INFINITY;
+        limit(b, target, vMax, acc);
+
+        float unit[TS4_MAX_GROUP_SIZE];
+        for (unsigned i = 0; i < axes; i++) unit[i] = (target[i] - last[i]) / b.length;
+
+        b.maxEntrySqr = junctionSqr(unit, b);
+        return push(b, unit);
+    }
+
+    bool PathPlanner::addArc(const int32_t* target, const uint32_t* vMax, const uint32_t* acc, const ArcSpec& arc)
+    {
+        unsigned ax = arc.axis[0], ay = arc.axis[1];
+        if (ax >= axes || ay >= axes || ax == ay) return false;
+
+        int32_t x0   = last[ax] - arc.center[0];
+        int32_t y0   = last[ay] - arc.center[1];
+        int64_t rSqr = (int64_t)x0 * x0 + (int64_t)y0 * y0;
+        if (rSqr == 0) return add(target, vMax, acc); // no circle, straight move
+
+        // the arc is split at the octant boundaries (multiples of 45°), the faster axis and the directions don't change in between
+        constexpr float octant = PI / 4;
+        float r       = sqrtf((float)rSqr);
+        float dir     = arc.ccw ? 1 : -1;
+        float start   = atan2f(y0, x0);
+        float sweep   = dir * (atan2f(target[ay] - arc.center[1], target[ax] - arc.center[0]) - start);
+        while (sweep <= 0) sweep += 2 * PI; // end angle == start angle: full circle
+
+        float ends[10];
+        unsigned nrPieces = 0;
+        int k             = arc.ccw ? (int)floorf(start / octant) + 1 : (int)ceilf(start / octant) - 1;
+        for (; nrPieces < 9 && dir * (start + dir * sweep - k * octant) > 0; k += (int)dir) ends[nrPieces++] = k * octant;
+        ends[nrPieces++] = start + dir * sweep;
+        if (queue.capacity() - queue.size() < nrPieces + 1) return false; // +1: straight correction at the end
+
+        int32_t from[TS4_MAX_GROUP_SIZE];
+        std::copy(last, last + axes, from);
+
+        float a0 = start;
+        for (unsigned p = 0; p < nrPieces; p++)
+        {
+            float a1  = ends[p];
+            float mid = 0.5f * (a0 + a1);
+            bool xLead = std::abs(sinf(mid)) >= std::abs(cosf(mid)); // |y| >= |x|: x is the faster axis
+
+            PathBlock b;
+            b.lead      = xLead ? ax : ay;
+            b.minor     = xLead ? ay : ax;
+            b.center[0] = arc.center[xLead ? 0 : 1];
+            b.center[1] = arc.center[xLead ? 1 : 0];
+            b.rSqr      = rSqr;
+
+            // end of the piece: lead coordinate on the circle, minor coordinate closest to it as chosen by the midpoint steps
+            int32_t u    = lroundf(r * (xLead ? cosf(a1) : sinf(a1)));
+            int64_t rest = rSqr - (int64_t)u * u;
+            int32_t m    = rest > 0 ? (int32_t)sqrtf((float)rest) : 0;
+            int64_t best = INT64_MAX;
+            int32_t v    = 0;
+            for (int32_t c = std::max(m - 1, 0); c <= m + 1; c++)
+            {
+                int64_t e = std::abs((int64_t)c * c - rest);
+                if (e < best)
+                {
+                    best = e;
+                    v    = c;
+                }
+            }
+            if ((xLead ? sinf(mid) : cosf(mid)) < 0) v = -v;
+
+            float share = p == nrPieces - 1 ? 1.0f : dir * (a1 - start) / sweep; // the other axes move proportional to the angle
+            for (unsigned i = 0; i < axes; i++) b.target[i] = from[i] + lroundf((target[i] - from[i]) * share);
+            b.target[b.lead]  = b.center[0] + u;
+            b.target[b.minor] = b.center[1] + v;
+
+            int32_t steps = std::abs(b.target[b.lead] - last[b.lead]);
+            if (steps == 0) // tiny piece at an octant boundary, the next one takes its steps
+            {
+                a0 = a1;
+                continue;
+            }
+            b.endsMove  = p == nrPieces - 1 && std::equal(target, target + axes, b.target); // else the correction ends it
+            b.length    = steps; // path length counted in lead steps: the ramp decelerates within the block
+            b.leadRatio = 1;
+            b.vMax      = std::min(vMax[ax], vMax[ay]);
+            b.acc       = std::min(acc[ax], acc[ay]);
+            limit(b, b.target, vMax, acc);
+            b.vMax = std::min(b.vMax, sqrtf(b.acc * r)); // centripetal acceleration
+
+            float unit[TS4_MAX_GROUP_SIZE] = {}, exitUnit[TS4_MAX_GROUP_SIZE] = {}; // tangents at both ends
+            unit[ax]     = -dir * sinf(a0);
+            unit[ay]     = dir * cosf(a0);
+            exitUnit[ax] = -dir * sinf(a1);
+            exitUnit[ay] = dir * cosf(a1);
+
+            b.maxEntrySqr = p == 0 ? junctionSqr(unit, b) : std::min(b.vMax * b.vMax, lastVMax * lastVMax); // pieces join tangentially
+            push(b, exitUnit);
+            a0 = a1;
+        }
+
+        for (unsigned i = 0; i < axes; i++)
+        {
+            if (last[i] != target[i]) return add(target, vMax, acc);
+        }
+        return true;
+    }
+
+    void PathPlanner::limit(PathBlock& b, const int32_t* target, const uint32_t* vMax, const uint32_t* acc)
+    {
+        for (unsigned i = 0; i < axes; i++)
+        {
+            int32_t d = target[i] - last[i];
+            if (d == 0 || (b.rSqr != 0 && (i == b.lead || i == b.minor))) continue; // plane axes of arcs are set by the caller
+
+            b.vMax = std::min(b.vMax, vMax[i] * b.length / std::abs(d)); // axis limits projected onto the path
+            b.acc  = std::min(b.acc, acc[i] * b.length / std::abs(d));
+        }
+        if (feedRate > 0) b.vMax = std::min(b.vMax, feedRate);
+        if (feedAcc > 0) b.acc = std::min(b.acc, feedAcc);
+    }
+
+    float PathPlanner::junctionSqr(const float* unit, const PathBlock& b) const
+    {
+        float cosTheta = 0; // of the angle between the previous and this block seen from the junction
+        for (unsigned i = 0; i < axes; i++) cosTheta -= lastUnit[i] * unit[i];
+
+        // junction deviation: corner speed of a circle touching both blocks at distance junctionDeviation from the corner
+        if (!hasLast || cosTheta > 0.999999f) return 0; // start of path or reversal
+
+        float vLimitSqr = std::min(b.vMax * b.vMax, lastVMax * lastVMax);
+        if (cosTheta < -0.999999f) return vLimitSqr; // straight line
+
+        float sinHalf = sqrtf(0.5f * (1.0f - cosTheta));
+        float vSqr    = std::min(b.acc, lastAcc) * junctionDeviation * sinHalf / (1.0f - sinHalf);
+        return std::min(vSqr, vLimitSqr);
+    }
+
+    bool PathPlanner::push(const PathBlock& block, const float* exitUnit)
+    {
+        PathBlock b = block;
+        b.entrySqr  = 0;
+        if (!queue.push(b)) return false;
+
+        for (unsigned i = 0; i < axes; i++)
+        {
+            last[i]     = b.target[i];
+            lastUnit[i] = exitUnit[i];
+        }
+        lastVMax = b.vMax;
+        lastAcc  = b.acc;
+        lastLead = b.lead;
+        hasLast  = true;
+        return true;
+    }
+
+    float PathPlanner::backwardPass()
+    {
+        float exitSqr = 0; // the path ends at standstill
+        for (int i = queue.size() - 1; i >= 0; i--)
+        {
+            PathBlock* b = queue.peek(i);
+            b->entrySqr  = std::min(b->maxEntrySqr, exitSqr + 2 * b->acc * b->length);
+            exitSqr      = b->entrySqr;
+        }
+        return exitSqr;
+    }
+
+    void PathPlanner::forwardPass(float headEntrySqr)
+    {
+        PathBlock* b = queue.peek();
+        if (b == nullptr) return;
+
+        b->entrySqr = headEntrySqr;
+        for (unsigned i = 1; i < queue.size(); i++)
+        {
+            PathBlock* next = queue.peek(i);
+            next->entrySqr  = std::min(next->entrySqr, b->entrySqr + 2 * b->acc * b->length);
+            b               = next;
+        }
+    }
+}
+
+#pragma pop_macro("abs")
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "ringbuffer.h"
+#include "stepperbase.h"
+#include <cstdint>
+
+namespace TS4
+{
+    /**
+     * One segment of a group path, straight or a piece of a circular arc
+     * Speeds and accelerations are measured along the path in steps (euclidean length of the step deltas),
+     * the lead axis runs at leadRatio times the path speed. Arc pieces lie within one octant of the circle:
+     * the lead is the faster plane axis, the minor plane axis follows the circle (StepBatch::setArc) and the
+     * lead ramp runs at path speed, stretched on every step by the local slope of the circle.
+     **/
+    struct PathBlock
+    {
+        int32_t target[TS4_MAX_GROUP_SIZE];
+        float length;      // steps
+        float leadRatio;   // lead axis steps per path step
+        float vMax;        // path speed limit from the vMax of all axes (steps/s)
+        float acc;         // path acceleration from the acc of all axes (steps/s^2)
+        float maxEntrySqr; // junction limit to the previous block
+        float entrySqr;    // planned entry speed²
+        int64_t rSqr;      // arc pieces: radius² of the circle, 0 for straight blocks
+        int32_t center[2]; // arc pieces: center coordinate on the lead and on the minor axis
+        uint8_t lead;      // axis with the most steps
+        uint8_t minor;     // arc pieces: plane axis following the circle
+        bool endsMove;     // last block of a queued move (queueMove, queueArc)
+    };
+
+    struct ArcSpec // circular arc in the plane of two group axes, the other axes move linearly (helix)
+    {
+        int32_t center[2]; // absolute position of the center on axis[0] and axis[1]
+        uint8_t axis[2];   // indices of the plane axes in the group
+        bool ccw;          // counterclockwise seen with axis[0] to the right and axis[1] up
+    };
+
+    /**
+     * Look-ahead planner for group paths
+     * Blocks are appended by the main loop and consumed by the lead stepper ISR. Every append computes the
+     * junction speed to the previous block from the junction deviation, then a backward pass (every block
+     * can stop at the end of the path) and a forward pass (every block is reachable from the entry of the
+     * block currently executed) set the entry speeds of all queued blocks. A pass touches at most
+     * TS4_QUEUE_SIZE blocks and must run with interrupts disabled while the group is moving.
+     **/
+    class PathPlanner
+    {
+     public:
+        void reset(const int32_t* pos, unsigned axes);                          // start a new path at pos, planner must be empty
+        bool add(const int32_t* target, const uint32_t* vMax, const uint32_t* acc); // false if the queue is full
+
+        // arc from the last target around arc.center, the plane axes end on the circle closest to their target, a straight
+        // block corrects the rest. An arc takes up to 10 blocks, false if they don't fit into the queue (nothing added)
+        bool addArc(const int32_t* target, const uint32_t* vMax, const uint32_t* acc, const ArcSpec& arc);
+
+        float backwardPass();                // returns the max entry speed² of the first queued block
+        void forwardPass(float headEntrySqr); // headEntrySqr: exit speed² committed by the running block
+
+        bool pop(PathBlock& block) { return queue.pop(block); }
+        PathBlock* peek(unsigned i = 0) { return queue.peek(i); }
+        void clear() { queue.clear(); }
+        unsigned size() const { return queue.size(); }
+
+        float junctionDeviation = 1.0f; // steps, larger values allow faster cornering
+        float feedRate          = 0;    // path speed limit (steps/s), 0: limited by the axes only
+        float feedAcc           = 0;    // path acceleration limit (steps/s^2), 0: limited by the axes only
+
+     protected:
+        RingBuffer<PathBlock, TS4_QUEUE_SIZE> queue;
+
+        void limit(PathBlock& b, const int32_t* target, const uint32_t* vMax, const uint32_t* acc); // axis and feed limits
+        float junctionSqr(const float* unit, const PathBlock& b) const; // max entry speed² after the last block
+        bool push(const PathBlock& b, const float* exitUnit);
+
+        unsigned axes = 0;
+        int32_t last[TS4_MAX_GROUP_SIZE]; // target of the last added block
+        float lastUnit[TS4_MAX_GROUP_SIZE];
+        float lastVMax = 0, lastAcc = 0;
+        bool hasLast     = false;
+        uint8_t lastLead = 0;
+    };
+}
@@ -0,0 +1,64 @@
+#include "posevents.h"
+
+namespace TS4
+{
+    bool PositionEvents::add(int32_t position, action_t action, uint8_t pin, isr_t callback, void* context)
+    {
+        if (n >= TS4_POSITION_EVENTS) return false;
+
+        noInterrupts();
+        unsigned i = n; // insertion sort, events with the same position keep their order
+        while (i > 0 && events[i - 1].position > position)
+        {
+            events[i] = events[i - 1];
+            i--;
+        }
+        events[i] = {position, action, pin, callback, context};
+        n         = n + 1;
+        if (position <= *pos) up++;
+        interrupts();
+        return true;
+    }
+
+    void PositionEvents::clear()
+    {
+        noInterrupts();
+        n  = 0;
+        up = 0;
+        interrupts();
+    }
+
+    void PositionEvents::rebase()
+    {
+        noInterrupts();
+        up = 0;
+        while (up < n && events[up].position <= *pos) up++;
+        interrupts();
+    }
+
+    void PositionEvents::fire(unsigned i)
+    {
+        event_t e = events[i];
+        for (unsigned k = i + 1; k < n; k++) events[k - 1] = events[k];
+        n = n - 1;
+
+        switch (e.action)
+        {
+            case action_t::setPin:
+                digitalWriteFast(e.pin, HIGH);
+                break;
+            case action_t::clearPin:
+                digitalWriteFast(e.pin, LOW);
+                break;
+            case action_t::togglePin:
+                digitalToggleFast(e.pin);
+                break;
+            case action_t::callback:
+                e.callback(e.context);
+                break;
+            case action_t::count:
+                *static_cast<volatile uint32_t*>(e.context) += 1;
+                break;
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Arduino.h"
+#include "timers/interfaces.h"
+#include <cstdint>
+
+#if !defined(TS4_POSITION_EVENTS)
+#define TS4_POSITION_EVENTS 16 // pending position events per stepper
+#endif
+
+namespace TS4
+{
+    /**
+     * Actions triggered when a stepper reaches a position
+     * The events are kept sorted by position, 'up' separates the ones at or below the current position from
+     * the ones above it. The step ISR (lead or Bresenham slave) only compares the neighbour of 'up' in the
+     * direction of the step, i.e. the check is O(1) per step. An event fires once, when its position is
+     * reached by a step, and is removed afterwards.
+     **/
+    class PositionEvents
+    {
+     public:
+        enum class action_t : uint8_t {
+            setPin,    // digitalWriteFast(pin, HIGH)
+            clearPin,  // digitalWriteFast(pin, LOW)
+            togglePin, // digitalToggleFast(pin)
+            callback,  // callback(context), called from the step ISR
+            count,     // ++*(volatile uint32_t*)context
+        };
+
+        PositionEvents(const volatile int32_t* pos)
+            : pos(pos)
+        {}
+
+        bool add(int32_t position, action_t action, uint8_t pin, isr_t callback = nullptr, void* context = nullptr); // false if full
+        void clear();
+        void rebase(); // the position was set from outside
+        unsigned size() const { return n; }
+
+        inline void stepped(int32_t dir); // step ISR, after the position was updated
+
+     protected:
+        struct event_t
+        {
+            int32_t position;
+            action_t action;
+            uint8_t pin;
+            isr_t callback;
+            void* context;
+        };
+
+        void fire(unsigned i); // runs and removes event i
+
+        event_t events[TS4_POSITION_EVENTS];
+        volatile unsigned n = 0;
+        unsigned up         = 0; // first event above the current position
+        const volatile int32_t* pos;
+    };
+
+    // inline implementation ===========================================================
+
+    void PositionEvents::stepped(int32_t dir)
+    {
+        if (n == 0) return;
+
+        int32_t p = *pos;
+        if (dir > 0)
+        {
+            while (up < n && events[up].position == p) fire(up);
+        }
+        else
+        {
+            while (up > 0 && events[up - 1].position > p) up--; // events at the position we left are above now
+            while (up > 0 && events[up - 1].position == p) fire(--up);
+        }
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+// Opt-in ISR profiling, define TS4_PROFILE (e.g. -DTS4_PROFILE) to enable.
+// Without it all probes compile to nothing and the statistics members and accessors do not exist.
+
+#if defined(TS4_PROFILE)
+
+#include "Arduino.h"
+#include <cstdint>
+#if defined(TS4_HOST)
+#include <chrono>
+#endif
+
+namespace TS4
+{
+    // Cortex-M7 cycle counter on the Teensy, nanoseconds of the host clock on host builds
+    inline uint32_t profileCounter()
+    {
+#if defined(TS4_HOST)
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+        return ARM_DWT_CYCCNT;
+#endif
+    }
+
+    inline uint32_t profileCounterFrequency() // Hz
+    {
+#if defined(TS4_HOST)
+        return 1'000'000'000;
+#else
+        return F_CPU_ACTUAL;
+#endif
+    }
+
+    struct IsrStats
+    {
+        static constexpr unsigned nrBins = 16;
+        uint32_t histogram[nrBins]; // bin i counts durations in [2^i, 2^(i+1)) counter ticks, last bin open ended
+        uint32_t calls;
+        uint32_t steps;      // steps serviced (stepper statistics only)
+        uint32_t maxTime;    // longest ISR (counter ticks)
+        uint32_t maxLatency; // longest delay from timer event to ISR entry (module statistics only, counter ticks)
+        uint64_t totalTime;
+
+        IsrStats() { clear(); }
+
+        void add(uint32_t ticks)
+        {
+            unsigned bin = ticks == 0 ? 0 : 31 - __builtin_clz(ticks);
+            histogram[bin < nrBins ? bin : nrBins - 1]++;
+            calls++;
+            totalTime += ticks;
+            if (ticks > maxTime) maxTime = ticks;
+        }
+
+        void addLatency(uint32_t ticks)
+        {
+            if (ticks > maxLatency) maxLatency = ticks;
+        }
+
+        uint32_t meanTime() const { return calls > 0 ? totalTime / calls : 0; }
+
+        void clear()
+        {
+            for (uint32_t& h : histogram) h = 0;
+            calls = steps = maxTime = maxLatency = 0;
+            totalTime                            = 0;
+        }
+    };
+
+    // measures the time from construction to end of scope
+    class IsrProbe
+    {
+     public:
+        IsrProbe(IsrStats& s)
+            : stats(s), start(profileCounter())
+        {}
+        ~IsrProbe() { stats.add(profileCounter() - start); }
+
+     protected:
+        IsrStats& stats;
+        const uint32_t start;
+    };
+}
+
+#define TS4_PROFILE_ISR(stats) TS4::IsrProbe ts4Probe_(stats)
+#define TS4_PROFILE_STEP(stats) ((stats).steps++)
+#define TS4_PROFILE_LATENCY(stats, ticks) ((stats).addLatency(ticks))
+
+#else
+
+#define TS4_PROFILE_ISR(stats)
+#define TS4_PROFILE_STEP(stats)
+#define TS4_PROFILE_LATENCY(stats, ticks)
+
+#endif
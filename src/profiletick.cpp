@@ -0,0 +1,66 @@
+#include "profiletick.h"
+
+namespace TS4
+{
+    namespace // private
+    {
+        struct slot_t
+        {
+            isr_t tick;
+            void* ctx; // nullptr: free
+        };
+        slot_t slots[TS4_TICK_SLOTS];
+        unsigned used      = 0;
+        ITickTimer* ticker = nullptr;
+
+        void tickAll(void*)
+        {
+            for (slot_t& slot : slots)
+            {
+                void* ctx = slot.ctx;
+                if (ctx != nullptr) slot.tick(ctx);
+            }
+        }
+    }
+
+    namespace ProfileTick
+    {
+        void attachTimer(ITickTimer* timer)
+        {
+            ticker = timer;
+        }
+
+        bool add(isr_t tick, void* ctx)
+        {
+            if (ticker == nullptr) return false;
+
+            noInterrupts(); // also called from step ISRs
+            slot_t* free = nullptr;
+            for (slot_t& slot : slots)
+            {
+                if (slot.ctx == ctx) free = &slot; // already registered
+                if (slot.ctx == nullptr && free == nullptr) free = &slot;
+            }
+            if (free != nullptr && free->ctx == nullptr)
+            {
+                free->tick = tick;
+                free->ctx  = ctx;
+                if (used++ == 0) ticker->begin(1'000'000 / TS4_TICK_HZ, tickAll, nullptr);
+            }
+            interrupts();
+            return free != nullptr;
+        }
+
+        void remove(void* ctx)
+        {
+            noInterrupts();
+            for (slot_t& slot : slots)
+            {
+                if (slot.ctx != ctx) continue;
+                slot.ctx = nullptr;
+                if (--used == 0) ticker->end();
+            }
+            interrupts();
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "timers/interfaces.h"
+
+#if !defined(TS4_TICK_HZ)
+#define TS4_TICK_HZ 10'000 // rate of the fixed rate profile (rampEngine_t::tick)
+#endif
+
+#if !defined(TS4_TICK_SLOTS)
+#define TS4_TICK_SLOTS 8 // steppers running the fixed rate profile at the same time
+#endif
+
+namespace TS4
+{
+    /**
+     * Fixed rate trajectory tick
+     * Calls the registered profile functions at TS4_TICK_HZ from a low priority timer. Steppers using
+     * rampEngine_t::tick register while they move: the tick computes their speed and publishes the step
+     * period, the step ISR only reloads it. The timer runs while at least one stepper is registered.
+     **/
+    namespace ProfileTick
+    {
+        extern void attachTimer(ITickTimer*);   // called by TS4::begin()
+        extern bool add(isr_t tick, void* ctx); // false if no timer is attached or all slots are used
+        extern void remove(void* ctx);
+    }
+}
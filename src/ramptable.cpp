@@ -0,0 +1,128 @@
+#include "ramptable.h"
+#include <cmath>
+
+namespace TS4
+{
+    namespace // private
+    {
+        constexpr unsigned slots   = TS4_RAMP_CACHE_SLOTS;
+        constexpr int32_t capacity = TS4_RAMP_TABLE_ENTRIES;
+
+        RampTable tables[slots];
+        uint32_t* buffers[slots]; // allocated on first use, reused after eviction
+
+        uint32_t useCounter = 0;
+        uint32_t nrHits     = 0;
+        uint32_t nrMisses   = 0;
+
+        RampTable* find(uint32_t acc, uint32_t vMax)
+        {
+            for (RampTable& t : tables)
+            {
+                if (t.periods != nullptr && t.acc == acc && t.vMax >= vMax) return &t;
+            }
+            return nullptr;
+        }
+
+        RampTable* freeSlot()
+        {
+            RampTable* lru = nullptr;
+            for (RampTable& t : tables)
+            {
+                if (t.periods == nullptr) return &t;
+                if (t.pinned || t.users > 0) continue;
+                if (lru == nullptr || t.lastUse < lru->lastUse) lru = &t;
+            }
+            return lru;
+        }
+    }
+
+    namespace RampCache
+    {
+        RampTable* acquire(uint32_t acc, uint32_t vMax)
+        {
+            noInterrupts(); // also called from step ISRs (group lead handover)
+            RampTable* t = find(acc, vMax);
+            if (t == nullptr)
+                nrMisses++;
+            else
+            {
+                nrHits++;
+                t->users++;
+                t->lastUse = ++useCounter;
+            }
+            interrupts();
+            return t;
+        }
+
+        void release(RampTable* table)
+        {
+            if (table != nullptr && table->users > 0) table->users--;
+        }
+
+        bool preload(uint32_t acc, uint32_t vMax)
+        {
+            if (acc == 0) return false;
+            if (find(acc, vMax) != nullptr) return true;
+
+            int32_t mMax = rampLength(acc, vMax);
+            if (mMax + 1 > capacity) return false;
+
+            noInterrupts();
+            RampTable* t = freeSlot();
+            if (t != nullptr) t->periods = nullptr; // evicted, acquire must not find it while it is rebuilt
+            interrupts();
+            if (t == nullptr) return false; // all slots pinned or in use
+
+            unsigned slot = t - tables;
+            if (buffers[slot] == nullptr) buffers[slot] = new uint32_t[capacity];
+
+            uint32_t* periods = buffers[slot];
+            periods[0]        = 0;
+            for (int32_t m = 1; m <= mMax; m++)
+            {
+                periods[m] = timerClock / sqrt(2.0 * acc * m);
+            }
+
+            noInterrupts();
+            t->acc     = acc;
+            t->vMax    = vMax;
+            t->mMax    = mMax;
+            t->periods = periods;
+            t->lastUse = ++useCounter;
+            interrupts();
+            return true;
+        }
+
+        bool addStatic(uint32_t acc, uint32_t vMax, const uint32_t* periods, int32_t mMax)
+        {
+            noInterrupts();
+            RampTable* t = freeSlot();
+            if (t != nullptr)
+            {
+                t->acc     = acc;
+                t->vMax    = vMax;
+                t->mMax    = mMax;
+                t->periods = periods;
+                t->pinned  = true;
+                t->lastUse = ++useCounter;
+            }
+            interrupts();
+            return t != nullptr;
+        }
+
+        size_t memoryUsage()
+        {
+            size_t bytes = 0;
+            for (uint32_t* b : buffers)
+            {
+                if (b != nullptr) bytes += capacity * sizeof(uint32_t);
+            }
+            return bytes;
+        }
+
+        size_t memoryLimit() { return slots * capacity * sizeof(uint32_t); }
+        uint32_t hits() { return nrHits; }
+        uint32_t misses() { return nrMisses; }
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "timers/interfaces.h"
+#include <cstddef>
+#include <cstdint>
+
+#if !defined(TS4_RAMP_CACHE_SLOTS)
+#define TS4_RAMP_CACHE_SLOTS 4 // number of cached ramp tables
+#endif
+
+#if !defined(TS4_RAMP_TABLE_ENTRIES)
+#define TS4_RAMP_TABLE_ENTRIES 2048 // max entries per dynamically built table (4 bytes each)
+#endif
+
+namespace TS4
+{
+    /**
+     * Precomputed step periods of an acceleration ramp
+     * periods[m] is the step period (ticks of TS4::timerClock) at ramp index m, i.e. at v² = 2·acc·m
+     * (see intramp.h). The index does not depend on the target speed, a table built for (acc, vMax)
+     * serves every move with the same acceleration and a target speed up to vMax. Tables are
+     * stored in timer base ticks, the timer applies its prescaler when loading the period.
+     **/
+    struct RampTable
+    {
+        uint32_t acc;            // steps/s^2
+        uint32_t vMax;           // steps/s
+        int32_t mMax;            // last ramp index stored in the table
+        const uint32_t* periods; // periods[1..mMax], periods[0] unused
+
+        volatile uint8_t users = 0; // steppers currently running on this table, never evicted while > 0
+        bool pinned            = false;
+        uint32_t lastUse       = 0;
+    };
+
+    constexpr uint32_t isqrt(uint64_t x)
+    {
+        uint64_t r = x, y = (x + 1) / 2;
+        while (y < r)
+        {
+            r = y;
+            y = (r + x / r) / 2;
+        }
+        return r;
+    }
+
+    constexpr uint32_t rampPeriod(uint32_t acc, int32_t m)
+    {
+        return isqrt((uint64_t)timerClock * timerClock / (2ull * acc * m));
+    }
+
+    constexpr int32_t rampLength(uint32_t acc, uint32_t vMax)
+    {
+        return (uint64_t)vMax * vMax / (2ull * acc);
+    }
+
+    /**
+     * Ramp table for a fixed configuration, generated at compile time (ends up in flash if declared constexpr):
+     *   constexpr TS4::StaticRampTable<50'000, 10'000> fastRamp;
+     *   TS4::RampCache::add(fastRamp);
+     **/
+    template <uint32_t acc, uint32_t vMax>
+    struct StaticRampTable
+    {
+        static constexpr int32_t mMax = rampLength(acc, vMax);
+        uint32_t periods[mMax + 1];
+
+        constexpr StaticRampTable()
+            : periods{}
+        {
+            for (int32_t m = 1; m <= mMax; m++)
+            {
+                periods[m] = rampPeriod(acc, m);
+            }
+        }
+    };
+
+    /**
+     * Small LRU cache of ramp tables
+     * Tables are built from the main loop (preload, called by the speed and acceleration setters of steppers
+     * using the integer engine) or added from constexpr tables (add). Starting a move only looks the table up,
+     * a miss (or a ramp longer than TS4_RAMP_TABLE_ENTRIES) makes the stepper use the computed integer ramp. Table memory is bounded by
+     * TS4_RAMP_CACHE_SLOTS * TS4_RAMP_TABLE_ENTRIES * 4 bytes.
+     **/
+    namespace RampCache
+    {
+        extern RampTable* acquire(uint32_t acc, uint32_t vMax); // returns nullptr on a miss, ISR safe
+        extern void release(RampTable* table);                  // ISR safe
+
+        extern bool preload(uint32_t acc, uint32_t vMax); // builds the table if missing (evicts the least recently used one), false if it doesn't fit
+        extern bool addStatic(uint32_t acc, uint32_t vMax, const uint32_t* periods, int32_t mMax);
+
+        template <uint32_t acc, uint32_t vMax>
+        bool add(const StaticRampTable<acc, vMax>& table) { return addStatic(acc, vMax, table.periods, table.mMax); }
+
+        extern size_t memoryUsage(); // bytes allocated for dynamically built tables
+        extern size_t memoryLimit(); // upper bound of memoryUsage()
+        extern uint32_t hits();
+        extern uint32_t misses();
+    }
+}
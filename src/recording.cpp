@@ -0,0 +1,298 @@
+#include "Arduino.h"
+
+#include "recording.h"
+#include "stepperbase.h"
+
+namespace TS4
+{
+    namespace // private
+    {
+        constexpr uint8_t magic[] = {'T', 'S', '4', 'R'};
+        constexpr uint8_t version = 1;
+
+        void put32(uint8_t* p, uint32_t v)
+        {
+            for (unsigned i = 0; i < 4; i++) p[i] = v >> (8 * i);
+        }
+
+        uint32_t get32(const uint8_t* p)
+        {
+            return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+        }
+    }
+
+    // StepRecording ================================================================================
+
+    void StepRecording::clear(unsigned axes)
+    {
+        nrAxes   = axes;
+        bytes    = 0;
+        nrSteps  = 0;
+        moved    = 0;
+        startDir = 0;
+        overflow = capacity < headerSize;
+        rejected = false;
+        writeHeader();
+    }
+
+    void StepRecording::writeHeader()
+    {
+        if (capacity < headerSize) return;
+
+        for (unsigned i = 0; i < 4; i++) buffer[i] = magic[i];
+        buffer[4] = version;
+        buffer[5] = nrAxes;
+        buffer[6] = moved;
+        buffer[7] = startDir;
+        put32(buffer + 8, nrSteps);
+        put32(buffer + 12, bytes);
+    }
+
+    bool StepRecording::load(uint32_t size)
+    {
+        nrAxes = 0;
+        if (size < headerSize || size > capacity) return false;
+        for (unsigned i = 0; i < 4; i++)
+        {
+            if (buffer[i] != magic[i]) return false;
+        }
+        uint32_t payload = get32(buffer + 12);
+        uint8_t axes     = buffer[5];
+        if (buffer[4] != version || axes == 0 || axes > TS4_RECORD_AXES || payload > size - headerSize) return false;
+
+        // walk the records once, the player decodes them in the ISR without any checks
+        uint8_t invalid = ~((1u << axes) - 1); // mask bits of axes not in the recording
+        if (buffer[6] & invalid) return false;
+
+        const uint8_t* p   = buffer + headerSize;
+        const uint8_t* end = p + payload;
+        uint32_t records = 0, period = 0;
+        while (p < end)
+        {
+            uint64_t word = 0;
+            for (unsigned shift = 0;; shift += 7)
+            {
+                if (p == end || shift > 28) return false; // truncated or longer than a recorder writes
+                uint8_t b = *p++;
+                word |= (uint64_t)(b & 0x7F) << shift;
+                if (!(b & 0x80)) break;
+            }
+            uint32_t zigzag = word >> 3;
+            period += (zigzag >> 1) ^ -(zigzag & 1);
+            unsigned extra = (word & 4 ? 2 : 0) + (word & 2 ? 1 : 0) + (word & 1 ? 1 : 0);
+            if ((uint32_t)(end - p) < extra) return false;
+            if (word & 4) p += 2;
+            if ((word & 2) && (*p++ & invalid)) return false;
+            if (word & 1) p++;
+            if (period == 0) return false; // would stall the timer
+            records++;
+        }
+        if (records != get32(buffer + 8)) return false;
+
+        nrAxes   = axes;
+        moved    = buffer[6];
+        startDir = buffer[7];
+        nrSteps  = records;
+        bytes    = payload;
+        overflow = false;
+        rejected = false;
+        return true;
+    }
+
+    // StepRecorder =================================================================================
+
+    bool StepRecorder::addAxis(StepperBase& stepper)
+    {
+        if (nrAxes >= TS4_RECORD_AXES || recording != nullptr) return false;
+
+        steppers[nrAxes] = &stepper;
+        pos[nrAxes]      = &stepper.pos;
+        nrAxes++;
+        return true;
+    }
+
+    bool StepRecorder::begin(StepRecording& rec)
+    {
+        if (nrAxes == 0 || recording != nullptr) return false;
+        for (unsigned i = 0; i < nrAxes; i++)
+        {
+            if (steppers[i]->isMoving && steppers[i]->mode == StepperBase::mmode_t::velocity) return false;
+        }
+
+        rec.clear(nrAxes);
+        noInterrupts();
+        for (unsigned i = 0; i < nrAxes; i++)
+        {
+            last[i]    = *pos[i];
+            lastDir[i] = 0; // the first step of each axis carries its direction
+            steppers[i]->recorder = this;
+        }
+        lastPeriod = 0;
+        lastFrac   = 0;
+        lastMask   = 0;
+        recording  = &rec;
+        interrupts();
+        return true;
+    }
+
+    void StepRecorder::reject()
+    {
+        if (recording != nullptr) recording->rejected = true;
+    }
+
+    void StepRecorder::end()
+    {
+        if (recording == nullptr) return;
+
+        noInterrupts();
+        for (unsigned i = 0; i < nrAxes; i++) steppers[i]->recorder = nullptr;
+        interrupts();
+        recording->writeHeader();
+        recording = nullptr;
+    }
+
+    // StepPlayer ===================================================================================
+
+    bool StepPlayer::addAxis(StepperBase& stepper)
+    {
+        if (nrAxes >= TS4_RECORD_AXES || isPlaying()) return false;
+
+        steppers[nrAxes++] = &stepper;
+        return true;
+    }
+
+    MoveToken StepPlayer::play(const StepRecording& rec, float timeScale)
+    {
+        if (isPlaying() || !rec.valid() || rec.axes() != nrAxes || rec.steps() == 0 || timeScale <= 0) return MoveToken();
+        for (unsigned i = 0; i < nrAxes; i++)
+        {
+            if (steppers[i]->isMoving || steppers[i]->player != nullptr) return MoveToken();
+        }
+
+        next      = rec.data() + StepRecording::headerSize;
+        remaining = rec.steps();
+        period    = 0;
+        frac      = 0;
+        mask      = 0;
+        scale     = timeScale;
+        pulse     = 0;
+        pending   = 0;
+        dirSetup  = false;
+        for (unsigned i = 0; i < nrAxes; i++)
+        {
+            steppers[i]->player = this;
+            if (rec.moved & (1 << i)) dirSetup |= steppers[i]->setDir(rec.startDir & (1 << i) ? 1 : -1); // same as the recorded move
+        }
+
+        timer = TimerFactory::makeTimer();
+        timer->setPulseParams(8, steppers[0]->stepPin);
+        timer->attachIsr(stepIsr, resetIsr, this);
+
+        noInterrupts();
+        MoveToken token = completion.begin();
+        interrupts();
+        timer->start();
+        return token;
+    }
+
+    void StepPlayer::stop()
+    {
+        noInterrupts();
+        if (isPlaying()) finish();
+        interrupts();
+    }
+
+    void StepPlayer::finish()
+    {
+        timer->stop();
+        TimerFactory::returnTimer(timer);
+        timer = nullptr;
+        resetIsr(this);
+        for (unsigned i = 0; i < nrAxes; i++) steppers[i]->player = nullptr;
+        completion.finish();
+    }
+
+    void StepPlayer::fire(uint8_t mask)
+    {
+        pulse = mask;
+        while (mask != 0)
+        {
+            StepperBase* stepper = steppers[__builtin_ctz(mask)];
+            digitalWriteFast(stepper->stepPin, HIGH);
+            stepper->pos += stepper->dir;
+            stepper->events.stepped(stepper->dir);
+            mask &= mask - 1;
+        }
+    }
+
+    void StepPlayer::stepIsr(void* ctx)
+    {
+        StepPlayer* self = static_cast<StepPlayer*>(ctx);
+        if (self->pending != 0) // direction setup time elapsed
+        {
+            self->fire(self->pending);
+            self->pending = 0;
+            return;
+        }
+        if (self->remaining == 0) // interval after the last step elapsed
+        {
+            self->finish();
+            return;
+        }
+        self->remaining--;
+
+        uint64_t word = 0;
+        for (unsigned shift = 0;; shift += 7)
+        {
+            uint8_t b = *self->next++;
+            word |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) break;
+        }
+        uint32_t zigzag = word >> 3;
+        self->period += (zigzag >> 1) ^ -(zigzag & 1);
+        if (word & 4)
+        {
+            self->frac = self->next[0] | self->next[1] << 8;
+            self->next += 2;
+        }
+        if (word & 2) self->mask = *self->next++;
+        uint8_t mask = self->mask;
+
+        if (self->scale == 1.0f)
+            self->timer->updatePeriod(self->period, self->frac);
+        else
+        {
+            uint64_t p = (((uint64_t)self->period << 16) | self->frac) * self->scale;
+            self->timer->updatePeriod(p >> 16, p & 0xFFFF);
+        }
+
+        bool changed = self->dirSetup; // first step after the start directions were written
+        self->dirSetup = false;
+        if (word & 1) // direction of at least one axis changed
+        {
+            uint8_t dirs = *self->next++;
+            for (uint8_t m = mask; m != 0; m &= m - 1)
+            {
+                unsigned i = __builtin_ctz(m);
+                changed |= self->steppers[i]->setDir(dirs & (1 << i) ? 1 : -1);
+            }
+        }
+        if (changed)
+        {
+            self->pending = mask;
+            self->timer->postpone(StepperBase::dirSetupTicks);
+            return;
+        }
+        self->fire(mask);
+    }
+
+    void StepPlayer::resetIsr(void* ctx)
+    {
+        StepPlayer* self = static_cast<StepPlayer*>(ctx);
+        for (uint8_t m = self->pulse; m != 0; m &= m - 1)
+        {
+            digitalWriteFast(self->steppers[__builtin_ctz(m)]->stepPin, LOW);
+        }
+        self->pulse = 0;
+    }
+}
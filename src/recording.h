@@ -0,0 +1,199 @@
+#pragma once
+
+#include "completion.h"
+#include "timers/interfaces.h"
+#include <cstdint>
+
+#if !defined(TS4_RECORD_AXES)
+#define TS4_RECORD_AXES 8 // steppers per recording (one bit of the step mask each)
+#endif
+
+namespace TS4
+{
+    class StepperBase;
+
+    /**
+     * Step stream of recorded moves in a caller supplied buffer (no heap, e.g. a static array or EXTMEM)
+     * The buffer is the serialized form: a 16 byte header (magic "TS4R", version, number of axes, axes moving and
+     * their start directions, steps and payload bytes, little endian) followed by one record per step event:
+     *   varint    zigzag(period - previous period) << 3 | F << 2 | M << 1 | D, period in ticks of timerClock
+     *   uint16_t  fraction of the period (1/65536 ticks), only if it changed (F)
+     *   uint8_t   mask of the axes stepping, only if it changed (M)
+     *   uint8_t   directions of the stepping axes (bit set: positive), only if one of them reversed (D)
+     * Steps at constant speed with an unchanged mask take 1 byte, others 2..6. The format doesn't depend on the
+     * platform, recordings made on a host build (TS4_HOST) play on the Teensy.
+     **/
+    class StepRecording
+    {
+     public:
+        static constexpr uint32_t headerSize = 16;
+
+        StepRecording(uint8_t* buffer, uint32_t capacity)
+            : buffer(buffer), capacity(capacity)
+        {}
+
+        void clear(unsigned axes); // empty recording of the given number of axes
+        bool load(uint32_t size);  // the buffer was filled from outside (upload, file), false if header or records are invalid
+
+        const uint8_t* data() const { return buffer; }
+        uint32_t size() const { return headerSize + bytes; } // serialized size
+        uint32_t steps() const { return nrSteps; }
+        unsigned axes() const { return nrAxes; }
+        bool valid() const { return nrAxes > 0 && !overflow && !rejected; } // false: nothing recorded, buffer too small or unsupported move
+
+     protected:
+        inline void put(uint8_t b);
+        inline void putVarint(uint64_t v);
+        void writeHeader();
+
+        uint8_t* buffer;
+        uint32_t capacity;
+        uint32_t bytes   = 0; // payload
+        uint32_t nrSteps = 0;
+        uint8_t nrAxes   = 0;
+        uint8_t moved    = 0; // axes stepping in the recording...
+        uint8_t startDir = 0; // ...and their direction at the first step (bit set: positive)
+        bool overflow    = false;
+        bool rejected    = false; // a move which can't be recorded ran on a recorded axis
+
+        friend class StepRecorder;
+        friend class StepPlayer;
+    };
+
+    /**
+     * Records the step events of the attached steppers into a StepRecording
+     * The stepper driving the timer (single stepper or lead of a group move) calls record() after each step:
+     * the steps of all axes are taken from their positions, the interval to the next step from its timer.
+     * All recorded moves must be driven by one timer at a time. Moves are appended back to back, the pause
+     * before a move is not recorded, the interval after the last step of a move is its stopping period.
+     * Supported: target, rotate, stopping and S-curve moves with any ramp engine, queued and group moves.
+     * Velocity streaming (its ISR runs between the steps) and group step streams (no step ISR) can't be
+     * recorded: begin() fails while an axis streams velocities, starting one later invalidates the recording.
+     **/
+    class StepRecorder
+    {
+     public:
+        bool addAxis(StepperBase& stepper);   // false if TS4_RECORD_AXES are attached or recording
+        bool begin(StepRecording& recording); // clears the recording, false if no axis was added
+        void end();                           // writes the header, the recording can be played or sent
+
+        inline void record(const ITimer* timer); // called from the step ISR
+        void reject();                           // an unsupported move started on a recorded axis
+
+     protected:
+        StepperBase* steppers[TS4_RECORD_AXES];
+        volatile int32_t* pos[TS4_RECORD_AXES];
+        int32_t last[TS4_RECORD_AXES];
+        int8_t lastDir[TS4_RECORD_AXES];
+        unsigned nrAxes = 0;
+
+        StepRecording* recording = nullptr;
+        uint32_t lastPeriod      = 0;
+        uint16_t lastFrac        = 0;
+        uint8_t lastMask         = 0;
+    };
+
+    /**
+     * Replays a StepRecording on the same axes (added in the order of the recorder)
+     * The step ISR only decodes the next record and writes the pins, no profile math. Direction changes wait
+     * for the driver setup time like a computed move. timeScale stretches all intervals (2: half speed).
+     * Positions and position events of the axes follow the steps. The axes don't count as moving (isMoving, no step
+     * timer of their own) but refuse moves of their own and of groups until the replay ends, their stop functions
+     * (stopAsync, emergencyStop) end the whole replay immediately.
+     **/
+    class StepPlayer
+    {
+     public:
+        ~StepPlayer() { stop(); }
+
+        bool addAxis(StepperBase& stepper);
+        MoveToken play(const StepRecording& recording, float timeScale = 1.0f); // done token if the recording doesn't fit or an axis is busy
+        void stop();                                                            // immediately, without ramping down
+        bool isPlaying() const { return timer != nullptr; }
+
+     protected:
+        static void stepIsr(void* self);
+        static void resetIsr(void* self);
+        void finish();
+        void fire(uint8_t mask);
+
+        StepperBase* steppers[TS4_RECORD_AXES];
+        unsigned nrAxes = 0;
+
+        ITimer* timer = nullptr;
+        const uint8_t* next;  // next record
+        uint32_t remaining;   // records not yet played
+        uint32_t period;      // decoded period, fraction and step mask
+        uint16_t frac;
+        uint8_t mask;
+        float scale;
+        uint8_t pulse   = 0;  // step pins set by the last step
+        uint8_t pending = 0;  // steps waiting for the direction setup time
+        bool dirSetup;        // start directions were written, the first step waits
+        Completion completion;
+    };
+
+    // inline implementation ===========================================================
+
+    void StepRecording::put(uint8_t b)
+    {
+        if (headerSize + bytes < capacity)
+            buffer[headerSize + bytes++] = b;
+        else
+            overflow = true;
+    }
+
+    void StepRecording::putVarint(uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            put((uint8_t)v | 0x80);
+            v >>= 7;
+        }
+        put((uint8_t)v);
+    }
+
+    void StepRecorder::record(const ITimer* timer)
+    {
+        uint8_t mask = 0, dirs = 0;
+        bool turned  = false;
+        for (unsigned i = 0; i < nrAxes; i++)
+        {
+            int32_t p = *pos[i];
+            if (p == last[i]) continue;
+
+            int8_t d = p > last[i] ? 1 : -1;
+            if (lastDir[i] == 0) // first step of the axis
+            {
+                recording->moved |= 1 << i;
+                if (d > 0) recording->startDir |= 1 << i;
+            }
+            turned |= d != lastDir[i];
+            lastDir[i] = d;
+            last[i]    = p;
+            mask |= 1 << i;
+            if (d > 0) dirs |= 1 << i;
+        }
+
+        uint32_t period = timer->getPeriod();
+        uint16_t frac   = timer->getPeriodFrac();
+        uint32_t delta  = period - lastPeriod;
+        uint32_t flags  = (frac != lastFrac) << 2 | (mask != lastMask) << 1 | turned;
+        lastPeriod      = period;
+
+        recording->putVarint((uint64_t)(delta << 1 ^ (uint32_t)((int32_t)delta >> 31)) << 3 | flags); // zigzag: small steps of both signs in few bytes
+        if (frac != lastFrac)
+        {
+            recording->put(frac);
+            recording->put(frac >> 8);
+            lastFrac = frac;
+        }
+        if (mask != lastMask)
+        {
+            recording->put(mask);
+            lastMask = mask;
+        }
+        if (turned) recording->put(dirs);
+        recording->nrSteps++;
+    }
+}
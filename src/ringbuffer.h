@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace TS4
+{
+    /**
+     * Lock free single producer / single consumer ring buffer
+     * The producer (main loop) pushes, the consumer (ISR) peeks and pops. N must be a power of 2.
+     **/
+    template <typename T, unsigned N>
+    class RingBuffer
+    {
+        static_assert(N > 1 && (N & (N - 1)) == 0, "RingBuffer size must be a power of 2");
+
+     public:
+        bool push(const T& item) // producer
+        {
+            uint32_t h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) >= N) return false; // full
+
+            buffer[h & (N - 1)] = item;
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        T* peek(unsigned i = 0) // consumer, i-th element from the front, nullptr if not available
+        {
+            uint32_t t = tail.load(std::memory_order_relaxed);
+            if (head.load(std::memory_order_acquire) - t <= i) return nullptr;
+            return &buffer[(t + i) & (N - 1)];
+        }
+
+        bool pop(T& item) // consumer
+        {
+            T* front = peek();
+            if (front == nullptr) return false;
+
+            item = *front;
+            tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            return true;
+        }
+
+        T& at(unsigned i) { return buffer[(tail.load(std::memory_order_relaxed) + i) & (N - 1)]; } // consumer, unchecked, i < size()
+
+        void drop(unsigned n) // consumer, removes n <= size() elements from the front
+        {
+            tail.store(tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+        }
+
+        void clear() // consumer
+        {
+            tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+        }
+
+        unsigned size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+        bool empty() const { return size() == 0; }
+        static constexpr unsigned capacity() { return N; }
+
+     protected:
+        T buffer[N];
+        std::atomic<uint32_t> head{0};
+        std::atomic<uint32_t> tail{0};
+    };
+}
@@ -0,0 +1,35 @@
+#include "scurve.h"
+#include <algorithm>
+#include <cmath>
+
+namespace TS4
+{
+    void SCurve::plan(int32_t _distance, uint32_t vMax, uint32_t aMax, uint32_t jerk)
+    {
+        const float D = _distance;
+        const float A = aMax;
+        const float J = jerk;
+
+        // peak speed: the acceleration phase (from 0 to V) covers V·T/2 steps, T = V/A + A/J (A reached) or 2·sqrt(V/J)
+        float V = vMax;
+        if (V * (V / A + A / J) > D) // no cruise phase
+        {
+            V = A / 2 * (sqrtf(A * A / (J * J) + 4 * D / A) - A / J);
+            if (V < A * A / J) V = cbrtf(D * D * J / 4); // max acceleration is not reached either
+        }
+
+        jMax     = J;
+        aPeak    = std::min(A, sqrtf(V * J)); // acceleration reached during the jerk phases
+        vPeak    = std::max(V, 1.0f);
+        vMin     = vPeak < vStart ? vPeak : vStart;
+        pPeak    = timerClock / vPeak;
+        distance = _distance;
+        decStart = (_distance + 1) / 2;
+
+        v        = vMin;
+        a        = 0;
+        period   = timerClock / v;
+        cruising = false;
+        stopping = false;
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "timers/interfaces.h"
+#include <cstdint>
+
+namespace TS4
+{
+    /**
+     * Jerk limited (7 phase) S-curve profile
+     * plan() computes the peak speed and acceleration of a symmetric move from and to the start speed:
+     * jerk up, constant acceleration, jerk down, cruise and the mirrored deceleration. The phases are
+     * selected from the current state (the acceleration is ramped out as soon as the remaining speed
+     * gain needs it), the deceleration starts at the mirror position of the measured acceleration distance.
+     * step() integrates jerk -> acceleration -> speed exactly over the duration of one step
+     * (one Newton iteration, two float divisions per step).
+     **/
+    class SCurve
+    {
+     public:
+        void plan(int32_t distance, uint32_t vMax, uint32_t aMax, uint32_t jerk); // reduces the peak speed for short moves
+        void stop() { stopping = true; }                                        // jerk limited stop from the current state
+
+        inline void step(int32_t s); // advance by one step, s: steps done in this move
+        bool done() const { return stopping && v <= vMin; }
+
+        uint32_t period; // current step period (timer ticks)
+        float v, a;      // current speed (steps/s) and acceleration (steps/s^2)
+
+     protected:
+        float jMax, aPeak, vPeak, vMin;
+        uint32_t pPeak;  // period at cruise speed
+        int32_t distance;
+        int32_t decStart; // half way until the acceleration phase is done
+        bool cruising, stopping;
+
+        static constexpr float vStart = 200; // start/stop speed, same as the other engines
+    };
+
+    // inline implementation ===========================================================
+
+    void SCurve::step(int32_t s)
+    {
+        float j, aLo, aHi;
+        if (stopping || s >= decStart) // decelerate, ramp the deceleration out just before the stop speed
+        {
+            j   = (a < 0 && v - vMin <= a * a / (2 * jMax)) ? jMax : -jMax;
+            aLo = -aPeak;
+            aHi = 0;
+        }
+        else if (!cruising) // accelerate, ramp the acceleration out just before the peak speed
+        {
+            j   = (v >= vPeak - a * a / (2 * jMax)) ? -jMax : jMax;
+            aLo = 0;
+            aHi = aPeak;
+        }
+        else
+        {
+            period = pPeak;
+            return;
+        }
+
+        // duration of the step: solve v·t + a·t²/2 + j·t³/6 = 1, one Newton iteration from t = 1/v
+        float t  = 1.0f / v;
+        float vt = v + (a + 0.5f * j * t) * t;
+        t -= (t * (v + (0.5f * a + j * t / 6) * t) - 1) / (vt > vMin ? vt : vMin);
+
+        v += (a + 0.5f * j * t) * t;
+        a += j * t;
+        a      = a < aLo ? aLo : (a > aHi ? aHi : a);
+        v      = v < vMin ? vMin : (v > vPeak ? vPeak : v);
+        period = timerClock * t;
+
+        if (aHi > 0 && (a <= 0 || v >= vPeak)) // acceleration done, cruise at the reached speed
+        {
+            cruising = true;
+            a        = 0;
+            vPeak    = v;
+            pPeak    = timerClock / v;
+            decStart = distance - (s + 1);
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#include "stepbatch.h"
+#include <cmath>
+
+namespace TS4
+{
+    void StepBatch::begin(unsigned leadPin)
+    {
+        nrSlaves = 0;
+        nrPorts  = 0;
+        hasArc   = false;
+        leadPort = addPort(leadPin, &leadMask);
+        for (uint32_t& p : pulse) p = 0;
+    }
+
+    SlaveAxis* StepBatch::addSlave(unsigned stepPin, volatile int32_t* pos, int32_t A, int32_t B, int32_t dir, PositionEvents* events)
+    {
+        if (nrSlaves >= TS4_MAX_GROUP_SIZE - 1) return nullptr;
+
+        SlaveAxis& slave = slaves[nrSlaves++];
+        slave.A          = A;
+        slave.B          = B;
+        slave.dir        = dir;
+        slave.pos        = pos;
+        slave.events     = events;
+        slave.port       = addPort(stepPin, &slave.mask);
+        return &slave;
+    }
+
+    void StepBatch::setArc(unsigned stepPin, volatile int32_t* pos, int32_t u, int32_t v, int32_t du, int32_t dv, int64_t rSqr, PositionEvents* events)
+    {
+        arc.u      = u;
+        arc.v      = v;
+        arc.du     = du;
+        arc.dv     = dv;
+        arc.F      = (int64_t)u * u + (int64_t)v * v - rSqr;
+        arc.radius = sqrtf((float)rSqr);
+        arc.pos    = pos;
+        arc.events = events;
+        arc.port   = addPort(stepPin, &arc.mask);
+        hasArc     = v != 0;
+    }
+
+    uint8_t StepBatch::addPort(unsigned pin, uint32_t* mask)
+    {
+#if defined(TS4_HOST)
+        *mask       = 1u << (pin % 32);
+        uint8_t reg = pin / 32;
+        for (unsigned p = 0; p < nrPorts; p++)
+        {
+            if (portNr[p] == reg) return p;
+        }
+        portNr[nrPorts] = reg;
+#else
+        *mask                  = digitalPinToBitMask(pin);
+        volatile uint32_t* reg = portSetRegister(pin);
+        for (unsigned p = 0; p < nrPorts; p++)
+        {
+            if (setReg[p] == reg) return p;
+        }
+        setReg[nrPorts]   = reg;
+        clearReg[nrPorts] = portClearRegister(pin);
+#endif
+        return nrPorts++;
+    }
+}
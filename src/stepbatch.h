@@ -0,0 +1,152 @@
+#pragma once
+
+#include "Arduino.h"
+#include "posevents.h"
+#include <cstdint>
+
+#if !defined(TS4_MAX_GROUP_SIZE)
+#define TS4_MAX_GROUP_SIZE 8 // max number of steppers in a group
+#endif
+
+namespace TS4
+{
+    struct SlaveAxis // Bresenham state of a dependent stepper
+    {
+        int32_t A, B;
+        int32_t dir;
+        volatile int32_t* pos;
+        PositionEvents* events;
+        uint32_t mask; // step pin bit in its port
+        uint8_t port;
+    };
+
+    struct ArcAxis // midpoint circle state of the minor plane axis of an arc block
+    {
+        int64_t F;      // u² + v² - r² at the current position
+        int32_t u, v;   // lead and minor coordinate relative to the center
+        int32_t du, dv; // direction of the lead and the minor axis, dv = 0: the minor axis doesn't move
+        float radius;
+        volatile int32_t* pos;
+        PositionEvents* events;
+        uint32_t mask;
+        uint8_t port;
+    };
+
+    /**
+     * Dependent steppers of a group move and their step pins grouped by GPIO port
+     * Built when a group move starts. The lead stepper ISR runs the Bresenham update of all slaves on
+     * this contiguous array and sets the step pins of each port with a single DR_SET write, the reset
+     * ISR clears them with one DR_CLEAR write per port.
+     **/
+    class StepBatch
+    {
+     public:
+        static constexpr unsigned maxPorts = 4; // GPIO6..9 on the Teensy 4
+
+        void begin(unsigned leadPin);                                                      // removes all slaves and the arc
+        SlaveAxis* addSlave(unsigned stepPin, volatile int32_t* pos, int32_t A, int32_t B, int32_t dir, PositionEvents* events = nullptr); // nullptr if full
+
+        // the minor plane axis of an arc: stepped when that brings the position closer to the circle of radius² rSqr.
+        // u, v: lead and minor position relative to the center, the lead must be the faster axis (|v| >= |u|) for the whole block
+        void setArc(unsigned stepPin, volatile int32_t* pos, int32_t u, int32_t v, int32_t du, int32_t dv, int64_t rSqr, PositionEvents* events = nullptr);
+
+        // Bresenham step of all slaves, sets the step pins of the lead and the slaves
+        // returns the path length of the next lead step for arcs (ITimer::scalePeriod), 0 for straight moves
+        inline float step(int32_t leadA);
+        inline void reset();             // clears the step pins set by step()
+
+        unsigned ports() const { return nrPorts; } // number of GPIO ports used by the step pins
+        uint32_t leadBit() const { return leadMask; }
+#if defined(TS4_HOST)
+        unsigned portBase() const { return portNr[0] * 32; } // first pin of the first port
+#else
+        volatile uint32_t* toggleRegister() const { return setReg[0] + 2; } // DR_TOGGLE of the first port
+#endif
+
+        SlaveAxis slaves[TS4_MAX_GROUP_SIZE - 1];
+        unsigned nrSlaves = 0;
+        ArcAxis arc;
+        bool hasArc = false;
+
+     protected:
+        uint8_t addPort(unsigned pin, uint32_t* mask);
+        inline void write(unsigned port, uint32_t bits, bool level);
+
+        uint32_t pulse[maxPorts]; // pins set by the last step
+        uint32_t leadMask;
+        uint8_t leadPort;
+        unsigned nrPorts = 0;
+#if defined(TS4_HOST)
+        uint8_t portNr[maxPorts]; // pins 32·n..32·n+31 form port n
+#else
+        volatile uint32_t* setReg[maxPorts];
+        volatile uint32_t* clearReg[maxPorts];
+#endif
+    };
+
+    // inline implementation ===========================================================
+
+    void StepBatch::write(unsigned port, uint32_t bits, bool level)
+    {
+#if defined(TS4_HOST)
+        while (bits != 0)
+        {
+            unsigned bit = __builtin_ctz(bits);
+            digitalWriteFast(portNr[port] * 32 + bit, level ? HIGH : LOW);
+            bits &= bits - 1;
+        }
+#else
+        *(level ? setReg[port] : clearReg[port]) = bits;
+#endif
+    }
+
+    float StepBatch::step(int32_t leadA)
+    {
+        for (unsigned p = 0; p < nrPorts; p++) pulse[p] = 0;
+        pulse[leadPort] = leadMask;
+
+        for (unsigned i = 0; i < nrSlaves; i++)
+        {
+            SlaveAxis& slave = slaves[i];
+            if (slave.B >= 0)
+            {
+                pulse[slave.port] |= slave.mask;
+                *slave.pos += slave.dir;
+                slave.B -= leadA;
+                if (slave.events != nullptr) slave.events->stepped(slave.dir);
+            }
+            slave.B += slave.A;
+        }
+
+        float stretch = 0;
+        if (hasArc) // integer midpoint circle: the lead moved, step the minor axis if that is closer to the circle
+        {
+            arc.F += 2 * (int64_t)arc.u * arc.du + 1;
+            arc.u += arc.du;
+            int64_t F = arc.F + 2 * (int64_t)arc.v * arc.dv + 1;
+            if (arc.dv != 0 && (F < 0 ? -F : F) < (arc.F < 0 ? -arc.F : arc.F))
+            {
+                arc.F = F;
+                arc.v += arc.dv;
+                pulse[arc.port] |= arc.mask;
+                *arc.pos += arc.dv;
+                if (arc.events != nullptr) arc.events->stepped(arc.dv);
+            }
+            stretch = arc.radius / (arc.v < 0 ? -arc.v : arc.v); // path steps per lead step = 1/cos of the tangent angle
+        }
+
+        for (unsigned p = 0; p < nrPorts; p++)
+        {
+            if (pulse[p] != 0) write(p, pulse[p], HIGH);
+        }
+        return stretch;
+    }
+
+    void StepBatch::reset()
+    {
+        for (unsigned p = 0; p < nrPorts; p++)
+        {
+            if (pulse[p] != 0) write(p, pulse[p], LOW);
+        }
+    }
+}
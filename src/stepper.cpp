@@ -16,6 +16,7 @@ namespace TS4
             overrideSpeed(vMax);
         }
         
+        preloadRamp();
         return *this;
     }
 
@@ -23,55 +24,133 @@ namespace TS4
     {
         avMax = ((vMax*vMax)/2);
         acc = std::min(a, avMax);
+        preloadRamp();
         return *this;
     }
 
-    void Stepper::rotateAsync(int32_t v)
+    Stepper& Stepper::setJerk(uint32_t j)
     {
+        jerk = j;
+        return *this;
+    }
+
+    Stepper& Stepper::setRampEngine(rampEngine_t e)
+    {
+        if (!isMoving) engine = e; // the running ISR is bound to the engine it was started with
+        preloadRamp();
+        return *this;
+    }
+
+    void Stepper::preloadRamp()
+    {
+        if (engine == rampEngine_t::integer) RampCache::preload(acc, std::abs(vMax)); // moves only look tables up, they may start from an ISR
+    }
+
+    MoveToken Stepper::rotateAsync(int32_t v)
+    {
+        if (player != nullptr) return MoveToken(); // replaying a recording
         StepperBase::startRotate(v == 0 ? vMax : v, acc);
+        return numberMove();
+    }
+
+    MoveToken Stepper::moveAbsAsync(int32_t target, uint32_t v)
+    {
+        if (player != nullptr) return MoveToken();
+        if (jerk > 0)
+            StepperBase::startSCurve(target, (v == 0 ? std::abs(vMax) : v), acc, jerk);
+        else
+            StepperBase::startMoveTo(target, 0, (v == 0 ? vMax : v), acc);
+        return numberMove();
+    }
+
+    MoveToken Stepper::moveRelAsync(int32_t delta, uint32_t v)
+    {
+        return moveAbsAsync(pos + delta, (v == 0 ? std::abs(vMax) : v));
     }
 
-    void Stepper::moveAbsAsync(int32_t target, uint32_t v)
+    bool Stepper::queueMoveAbs(int32_t target, uint32_t v)
     {
-        StepperBase::startMoveTo(target, 0, (v == 0 ? vMax : v), acc);
+        if (player != nullptr) return false;
+        if (!queue.push({target, (v == 0 ? (uint32_t)std::abs(vMax) : v), acc})) return false;
+        queueEnd = target;
+
+        noInterrupts();
+        completion.begin();
+        bool idle = !isMoving;
+        if (!idle) continueQueue();
+        interrupts();
+
+        if (idle) startQueued();
+        return true;
     }
 
-    void Stepper::moveRelAsync(int32_t delta, uint32_t v)
+    bool Stepper::queueMoveRel(int32_t delta, uint32_t v)
     {
-        StepperBase::startMoveTo(pos + delta, 0, (v == 0 ? std::abs(vMax) : v), acc);
+        int32_t from = !queue.empty() ? queueEnd : (isMoving ? segment.target : pos);
+        return queueMoveAbs(from + delta, v);
+    }
+
+    bool Stepper::onPosition(int32_t position, uint8_t pin, bool level)
+    {
+        pinMode(pin, OUTPUT);
+        return events.add(position, level ? PositionEvents::action_t::setPin : PositionEvents::action_t::clearPin, pin);
+    }
+
+    bool Stepper::onPosition(int32_t position, isr_t cb, void* ctx)
+    {
+        return events.add(position, PositionEvents::action_t::callback, 0, cb, ctx);
+    }
+
+    bool Stepper::onPosition(int32_t position, volatile uint32_t& counter)
+    {
+        return events.add(position, PositionEvents::action_t::count, 0, nullptr, (void*)&counter);
+    }
+
+    bool Stepper::streamVelocity(int32_t v, uint32_t at)
+    {
+        noInterrupts();
+        bool streaming = isMoving && mode == mmode_t::velocity;
+        bool busy      = (isMoving && !streaming) || player != nullptr;
+        interrupts();
+        if (busy) return false;
+
+        if (!streaming) setpoints.clear(); // ISR not running, drop what was left by a previous stream
+        if (!setpoints.push({constrain(v, -vMaxMax, vMaxMax), at})) return false;
+        if (!streaming) startVelocity(acc);
+        return true;
     }
 
     void Stepper::stopAsync()
     {
+        if (player != nullptr) // a replay can't ramp down, it stops immediately
+        {
+            player->stop();
+            return;
+        }
         StepperBase::startStopping(0, acc);
+        noInterrupts(); // ISR doesn't pop while stopping
+        queue.clear();
+        interrupts();
     }
 
-    void Stepper::moveAsync()
+    MoveToken Stepper::moveAsync()
     {
-        StepperBase::startMoveTo(target, 0, std::abs(vMax), acc);
+        return moveAbsAsync(target, std::abs(vMax));
     }
 
     void Stepper::moveAbs(int32_t target, uint32_t v)
     {
-        moveAbsAsync(target, v);
-        while (isMoving)
-        {
-            delay(10);
-        }
+        moveAbsAsync(target, v).wait();
     }
 
     void Stepper::moveRel(int32_t delta, uint32_t v)
     {
-        moveRelAsync(delta, v);
-        while (isMoving)
-        {
-            delay(10);
-        }
+        moveRelAsync(delta, v).wait();
     }
 
     void Stepper::stop()
     {
-        StepperBase::startStopping(0, acc);
+        stopAsync();
     }
 
     // void moveRelAsync(int delta);
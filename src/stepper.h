@@ -12,34 +12,75 @@ namespace TS4
         {}
 
         int32_t getPosition() const { return pos; }
-        void setPosition(int32_t p) { pos = p; }
+        void setPosition(int32_t p)
+        {
+            pos = p;
+            events.rebase();
+        }
 
         Stepper& setMaxSpeed(int32_t speed, bool force = false);   // steps/s
                                                        // StepperBase& setVStart(int32_t vIn);              // steps/s
                                                        // StepperBase& setVStop(int32_t vIn);               // steps/s
         Stepper& setAcceleration(uint32_t _a);         // steps/s^2
+        Stepper& setJerk(uint32_t j);                  // steps/s^3, moves use the S-curve profile if > 0 (queued moves stay trapezoidal)
+        Stepper& setRampEngine(rampEngine_t e);        // sqrt (default), integer or tick, ignored while moving
                                                        //
         void setTargetAbs(int32_t pos) { target = pos; }; // Set target position absolute
                                                        // void setTargetRel(int32_t delta);                 // Set target position relative to current position
 
-        void moveAsync();
-        void moveAbsAsync(int32_t target, uint32_t v = 0);
+        MoveToken moveAsync();
+        MoveToken moveAbsAsync(int32_t target, uint32_t v = 0); // the token is done when the stepper stops
         void moveAbs(int32_t target, uint32_t v = 0);
 
-        void moveRelAsync(int32_t delta, uint32_t v = 0);
+        MoveToken moveRelAsync(int32_t delta, uint32_t v = 0);
         void moveRel(int32_t delta, uint32_t v = 0);
 
-        void rotateAsync(int32_t v = 0);
+        bool queueMoveAbs(int32_t target, uint32_t v = 0); // append to the move queue, starts immediately if idle, false if the queue is full
+        bool queueMoveRel(int32_t delta, uint32_t v = 0);  // relative to the target of the previously queued move
+        unsigned queuedMoves() const { return queue.size(); }
+
+        MoveToken rotateAsync(int32_t v = 0);
         void stopAsync();
         void stop();
 
+        // velocity streaming: the stepper follows setpoints v (steps/s) due at micros() == at, interpolated by the step ISR
+        // and limited by the acceleration. Starts the stream if idle, false if the buffer is full or another move is running.
+        // If no setpoint follows, the last one is held for TS4_VELOCITY_HOLD_US, then the stepper ramps down and stops.
+        bool streamVelocity(int32_t v, uint32_t at);
+        bool streamVelocity(int32_t v) { return streamVelocity(v, micros()); }
+
+        // cb(ctx) is called when the stepper stops, from the step ISR or, if deferred, from TS4::handleEvents()
+        Stepper& onDone(isr_t cb, void* ctx = nullptr, bool deferred = false)
+        {
+            completion.setCallback(cb, ctx, deferred);
+            return *this;
+        }
+        MoveToken lastMove() const { return completion.last(); } // token of the latest started or queued move
+
+        // actions fired from the step ISR when a step reaches the position, also while the stepper is a dependent stepper of a group
+        // the events fire once, up to TS4_POSITION_EVENTS can be pending, false if full
+        bool onPosition(int32_t position, uint8_t pin, bool level); // writes the pin
+        bool onPosition(int32_t position, isr_t cb, void* ctx = nullptr);
+        bool onPosition(int32_t position, volatile uint32_t& counter); // increments the counter
+        void clearPositionEvents() { events.clear(); }
+        unsigned positionEvents() const { return events.size(); } // pending events
+
+#if defined(TS4_PROFILE)
+        const IsrStats& getStepIsrStats() const { return stepStats; }   // durations of the step ISR, steps serviced
+        const IsrStats& getResetIsrStats() const { return resetStats; } // durations of the pulse reset ISR
+        void clearIsrStats() { stepStats.clear(); resetStats.clear(); }
+#endif
+
 
 
         int32_t vMax = vMaxDefault;
         uint32_t acc  = aDefault;
+        uint32_t jerk = 0;
         uint32_t avMax;
        // uint32_t s_t  = 0;
      protected:
+        int32_t queueEnd = 0; // target of the last queued move
+        void preloadRamp();   // integer engine: builds the ramp table of vMax and acc (main loop)
 
         static constexpr int32_t vMaxMax       = 100'000; // largest speed possible (steps/s)
         static constexpr uint32_t aMax          = 999'999; // speed up to 500kHz within 1 s (steps/s^2)
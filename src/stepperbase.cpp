@@ -26,43 +26,82 @@ namespace TS4
 
         if (!isMoving)
         {
-            stpTimer = TimerFactory::makeTimer();
+            stpTimer = ownsPulse() ? TimerFactory::makeTimer(stepPin) : TimerFactory::makeTimer();
             stpTimer->setPulseParams(8, stepPin);
-            stpTimer->attachCallbacks([this] { rotISR(); }, [this] { resetISR(); });
-            v_sqr = vDir * 200 * 200;
-            
-            // Only set mode to rotate if we're not in stopping mode
-            if (mode != mmode_t::stopping) {
-                mode = mmode_t::rotate;
+            pinOutput = ownsPulse() && stpTimer->usePinOutput(stepPin); // single interrupt per step if the timer drives the pin
+            v_sqr     = vDir * 200 * 200;
+            if (setDir(signum(v_tgt))) dirSetup = true; // direction of the first step
+
+            if (engine == rampEngine_t::integer)
+            {
+                stpTimer->attachIsr(callStepIsr<&StepperBase::intRotISR>, callIsr<&StepperBase::resetISR>, this);
+                ramp.useTable(RampCache::acquire(a, std::abs(v_tgt)));
+                ramp.start(v_sqr * vDir, twoA, std::abs(v_tgt));
             }
-            
-            stpTimer->start();
+            else if (engine == rampEngine_t::tick && startTick())
+            {
+                vTick = signum(v_tgt) * 200.0f;
+                publishTick();
+                stpTimer->attachIsr(callStepIsr<&StepperBase::tickISR>, callIsr<&StepperBase::resetISR>, this);
+            }
+            else
+            {
+                stpTimer->attachIsr(callStepIsr<&StepperBase::rotISR>, callIsr<&StepperBase::resetISR>, this);
+            }
+
+            mode = mmode_t::rotate; // not moving, a stale stopping mode must not abort the new rotation
+            startTimer();
             isMoving = true;
         }
+        else if (engine == rampEngine_t::integer)
+        {
+            noInterrupts();
+            ramp.start(ramp.vSqr(), twoA, std::abs(v_tgt));
+            interrupts();
+        }
         // No else clause needed - we always update the motion parameters
     }
 
-    void StepperBase::startMoveTo(int32_t _s_tgt, int32_t v_e, uint32_t v_tgt, uint32_t a)
+    void StepperBase::startMoveTo(int32_t _s_tgt, int32_t v_e, uint32_t v_tgt, uint32_t a, int32_t v_s, ITimer* running)
     {
+        segment      = {_s_tgt, v_tgt, a};
+        segmentStart = pos;
+
         s          = 0;
         int32_t ds = std::abs(_s_tgt - pos);
         s_tgt      = ds;
 
-        dir = signum(_s_tgt - pos);
-        digitalWriteFast(dirPin, dir > 0 ? HIGH : LOW);
-        delayMicroseconds(5);
+        int32_t newDir = signum(_s_tgt - pos);
+        int64_t v0_sqr = 0; // speed at segment start, keep it if we continue in the same direction
+        if (v_s > 0 && (!isMoving || newDir == dir || newDir == 0))
+        {
+            v0_sqr = (int64_t)v_s * v_s;
+        }
+        else if (v_s < 0 && isMoving && (newDir == dir || newDir == 0))
+        {
+            int64_t vCur_sqr = mode == mmode_t::scurve ? (int64_t)(scurve.v * scurve.v) : (engine == rampEngine_t::integer ? ramp.vSqr() : v_sqr);
+            v0_sqr           = std::max<int64_t>(vCur_sqr, 200 * 200);
+        }
+        if (newDir != 0 && (newDir != dir || !isMoving))
+        {
+            if (setDir(newDir)) dirSetup = true; // the next step waits for the setup time
+        }
 
-        twoA = 2 * a;
-        // v_sqr      = (int64_t) v * v;
-        v_sqr     = 0;
-        v         = 0;
+        twoA      = 2 * a;
+        v_sqr     = v0_sqr;
         v_tgt_sqr = (int64_t)v_tgt * v_tgt;
+        int64_t ve_sqr = std::min<int64_t>((int64_t)v_e * v_e, v_tgt_sqr);
 
-        int64_t accLength = (v_tgt_sqr - v_sqr) / twoA + 1;
-        if (accLength >= ds / 2) accLength = ds / 2;
+        int64_t accLength = (v_tgt_sqr - v0_sqr) / twoA + 1;
+        int64_t decLength = (v_tgt_sqr - ve_sqr) / twoA + 1;
+        if (accLength + decLength > ds) // no constant speed phase, accelerate to where the deceleration starts
+        {
+            accLength = std::max<int64_t>(0, std::min<int64_t>(ds, (ds + (ve_sqr - v0_sqr) / twoA) / 2));
+            decLength = ds - accLength;
+        }
 
         accEnd   = accLength - 1;
-        decStart = s_tgt - accLength;
+        decStart = s_tgt - decLength;
 
         // SerialUSB1.printf("TimerAddr: %p\n", &stpTimer);
         // SerialUSB1.printf("a: %6d   twoA:  %6d\n", a, twoA);
@@ -72,16 +111,212 @@ namespace TS4
 
         if (!isMoving)
         {
-            // Serial.println("ismoving");
-            stpTimer = TimerFactory::makeTimer();
-
-            stpTimer->attachCallbacks([this] { stepISR(); }, [this] { resetISR(); });
-            stpTimer->setPulseParams(8, stepPin);
+            if (running == nullptr)
+            {
+                stpTimer = ownsPulse() ? TimerFactory::makeTimer(stepPin) : TimerFactory::makeTimer();
+                stpTimer->setPulseParams(8, stepPin);
+                pinOutput = ownsPulse() && stpTimer->usePinOutput(stepPin);
+            }
+            else // group lead handover, the timer is in its step ISR
+            {
+                stpTimer  = running;
+                pinOutput = false;
+                if (engine == rampEngine_t::tick) // ProfileTick::add might have to start the tick timer
+                {
+                    engine       = rampEngine_t::sqrt;
+                    tickFallback = true;
+                }
+            }
             isMoving = true;
-            v_sqr    = 200 * 200;
-            mode     = mmode_t::target;
-            stpTimer->start();
+            v_sqr    = std::max<int64_t>(v0_sqr, 200 * 200);
+
+            isr_t step = callStepIsr<&StepperBase::stepISR>;
+            if (engine == rampEngine_t::integer)
+            {
+                step = callStepIsr<&StepperBase::intStepISR>;
+                ramp.useTable(RampCache::acquire(a, v_tgt));
+                ramp.start(v_sqr, twoA, v_tgt);
+                ramp.setExit(ve_sqr);
+            }
+            else if (engine == rampEngine_t::tick && startTick())
+            {
+                step  = callStepIsr<&StepperBase::tickISR>;
+                vTick = sqrtf(v_sqr);
+                vExit = sqrtf(ve_sqr);
+                publishTick();
+            }
+            stpTimer->attachIsr(step, callIsr<&StepperBase::resetISR>, this);
+            mode = mmode_t::target;
+
+            if (running == nullptr)
+                startTimer();
+            else // first step of the new lead replaces the step of the old one
+            {
+                stepPostponed = false;
+                firstStep     = true;
+                step(this);
+            }
+        }
+        else
+        {
+            if (mode == mmode_t::scurve) // continue with the trapezoidal profile
+            {
+                if (engine == rampEngine_t::integer)
+                    stpTimer->attachIsr(callStepIsr<&StepperBase::intStepISR>, callIsr<&StepperBase::resetISR>, this);
+                else
+                    stpTimer->attachIsr(callStepIsr<&StepperBase::stepISR>, callIsr<&StepperBase::resetISR>, this);
+                mode = mmode_t::target;
+            }
+            if (v_sqr == 0) v_sqr = 200 * 200; // reversing
+            if (engine == rampEngine_t::integer)
+            {
+                ramp.start(v_sqr, twoA, v_tgt);
+                ramp.setExit(ve_sqr);
+            }
+            else if (engine == rampEngine_t::tick)
+            {
+                vTick = std::abs(vTick); // continues with the current speed, as the sqrt engine
+                vExit = sqrtf(ve_sqr);
+            }
+        }
+    }
+
+    bool StepperBase::startTick()
+    {
+        tickDone = false;
+        if (ProfileTick::add(callIsr<&StepperBase::profileTick>, this)) return true;
+
+        engine       = rampEngine_t::sqrt; // no tick timer attached or all slots in use, for this move only
+        tickFallback = true;
+        return false;
+    }
+
+    void StepperBase::profileTick()
+    {
+        if (!isMoving || tickDone) return;
+
+        constexpr float vMin = 200; // start and stop speed of all engines
+        float dv             = twoA * (0.5f / TS4_TICK_HZ);
+        float v              = std::abs(vTick);
+
+        if (mode == mmode_t::stopping || (mode == mmode_t::rotate && (v_tgt == 0 || vTick * v_tgt < 0))) // decelerate to the start speed
+        {
+            if (v - dv > vMin)
+                vTick = vTick > 0 ? v - dv : dv - v;
+            else if (mode == mmode_t::rotate && v_tgt != 0)
+                vTick = signum(v_tgt) * vMin; // reverse
+            else
+                tickDone = true;
+        }
+        else if (mode == mmode_t::rotate)
+        {
+            vTick = vTick < v_tgt ? std::min(vTick + dv, (float)v_tgt) : std::max(vTick - dv, (float)v_tgt);
+        }
+        else if (mode == mmode_t::target)
+        {
+            noInterrupts(); // the step ISR (higher priority) advances s and starts queued segments
+            int32_t left    = s_tgt - s;
+            int64_t vMaxSqr = v_tgt_sqr; // overrideSpeed might change it
+            interrupts();
+
+            float vMax   = sqrtf(vMaxSqr);
+            float steps  = left - v * (1.0f / TS4_TICK_HZ);                   // left after this tick
+            bool braking = v * v >= vExit * vExit + twoA * std::max(steps, 0.0f); // v² = vExit² + 2a·steps
+            if (braking)
+                vTick = std::max(v - dv, std::max(vExit, vMin));
+            else
+                vTick = v < vMax ? std::min(v + dv, vMax) : std::max(v - dv, vMax);
+        }
+        publishTick();
+    }
+
+    void StepperBase::startSCurve(int32_t _s_tgt, uint32_t v_tgt, uint32_t a, uint32_t j)
+    {
+        if (isMoving) // no jerk limited re-planning of a running move
+        {
+            startMoveTo(_s_tgt, 0, v_tgt, a);
+            return;
+        }
+
+        segment      = {_s_tgt, v_tgt, a};
+        segmentStart = pos;
+
+        s     = 0;
+        s_tgt = std::abs(_s_tgt - pos);
+        if (setDir(signum(_s_tgt - pos))) dirSetup = true;
+
+        scurve.plan(s_tgt, v_tgt, a, j);
+
+        stpTimer = ownsPulse() ? TimerFactory::makeTimer(stepPin) : TimerFactory::makeTimer();
+        stpTimer->attachIsr(callStepIsr<&StepperBase::scurveISR>, callIsr<&StepperBase::resetISR>, this);
+        stpTimer->setPulseParams(8, stepPin);
+        pinOutput = ownsPulse() && stpTimer->usePinOutput(stepPin);
+        isMoving  = true;
+        mode      = mmode_t::scurve;
+        startTimer();
+    }
+
+    void StepperBase::startVelocity(uint32_t a)
+    {
+        twoA      = 2 * a;
+        vNow      = 0;
+        phase     = 0;
+        lastTicks = 0; // start() calls the ISR right away
+        clockUs   = micros();
+        clockRest = 0;
+        reached   = {0, clockUs};
+
+        if (recorder != nullptr) recorder->reject(); // the timer period isn't the step interval
+        stpTimer = TimerFactory::makeTimer(); // most ISRs don't step, the pulses are written by software
+        stpTimer->attachIsr(callStepIsr<&StepperBase::velocityISR>, callIsr<&StepperBase::resetISR>, this);
+        stpTimer->setPulseParams(8, stepPin);
+        pinOutput = false;
+        isMoving  = true;
+        mode      = mmode_t::velocity;
+        startTimer();
+    }
+
+    bool StepperBase::startQueued()
+    {
+        segment_t seg;
+        if (!queue.pop(seg)) return false;
+        if (isMoving) completion.advance(); // called from the ISR, the previous segment is done
+
+        nextSegment    = nextQueued;
+        nextSegmentCtx = this;
+
+        segment      = seg; // exitSpeedSqr looks from this segment to the next one
+        segmentStart = pos;
+        startMoveTo(seg.target, sqrtf(exitSpeedSqr(queue.peek())), seg.vMax, seg.acc);
+        return true;
+    }
+
+    void StepperBase::continueQueue()
+    {
+        if (nextSegment == nullptr) // running move was not started from the queue, continue with the queue afterwards
+        {
+            nextSegment    = nextQueued;
+            nextSegmentCtx = this;
         }
+        else if (nextSegment == nextQueued && queue.size() == 1 && mode == mmode_t::target && s < decStart) // re-plan, don't stop at the end of the current segment
+        {
+            int64_t ve_sqr = exitSpeedSqr(queue.peek());
+            if (ve_sqr > 0) startMoveTo(segment.target, sqrtf(ve_sqr), segment.vMax, segment.acc);
+        }
+    }
+
+    int64_t StepperBase::exitSpeedSqr(const segment_t* next) const
+    {
+        if (next == nullptr) return 0;
+
+        int32_t d1 = segment.target - segmentStart;
+        int32_t d2 = next->target - segment.target;
+        if ((int64_t)d1 * d2 <= 0) return 0; // reversing or empty segment
+
+        // not faster than both segments allow and slow enough to stop at the end of the next segment
+        return std::min<int64_t>({(int64_t)segment.vMax * segment.vMax,
+                                  (int64_t)next->vMax * next->vMax,
+                                  2ll * std::min(segment.acc, next->acc) * std::abs(d2)});
     }
 
     // void StepperBase::rotateAsync()
@@ -110,11 +345,25 @@ namespace TS4
 
     void StepperBase::emergencyStop()
     {
+        if (player != nullptr) // ends the replay on all its axes
+        {
+            player->stop();
+            return;
+        }
+        if (!isMoving) return;
+
         stpTimer->stop();
         TimerFactory::returnTimer(stpTimer);
-        stpTimer = nullptr;
-        isMoving = false;
-        v_sqr    = 0;
+        stpTimer      = nullptr;
+        stepPostponed = false;
+        isMoving      = false;
+        v_sqr         = 0;
+        RampCache::release(ramp.table);
+        ramp.useTable(nullptr);
+        endEngine();
+        nextSegment = nullptr;
+        queue.clear();
+        notifyDone();
     }
 
     void StepperBase::overrideSpeed(int32_t newSpeed, uint32_t acceleration)
@@ -125,7 +374,9 @@ namespace TS4
         }
 
         noInterrupts(); // Critical section - avoid ISR conflicts
-        
+
+        if (engine == rampEngine_t::integer) v_sqr = ramp.vSqr();
+
         if (mode == mmode_t::rotate)
         {
             // Update target velocity for rotation mode
@@ -213,7 +464,9 @@ namespace TS4
             }
             // If we're already decelerating, don't change the profile
         }
-        
+
+        if (engine == rampEngine_t::integer && isMoving) ramp.start(v_sqr, twoA, std::abs(v_tgt));
+
         interrupts(); // End critical section
     }
 }
@@ -4,12 +4,41 @@
 #pragma push_macro("abs")
 #undef abs
 
+#include "completion.h"
+#include "gearing.h"
+#include "intramp.h"
+#include "posevents.h"
+#include "profiletick.h"
+#include "recording.h"
+#include "ringbuffer.h"
+#include "scurve.h"
+#include "stepbatch.h"
 #include "timers/interfaces.h"
 #include "timers/timerfactory.h"
 #include <algorithm>
 #include <cstdint>
 #include <string>
 
+#if !defined(TS4_QUEUE_SIZE)
+#define TS4_QUEUE_SIZE 16 // queued moves per stepper and per group, power of 2
+#endif
+
+#if !defined(TS4_DIR_SETUP_US)
+#define TS4_DIR_SETUP_US 5 // driver setup time from a direction change to the next step edge
+#endif
+
+#if !defined(TS4_VELOCITY_SETPOINTS)
+#define TS4_VELOCITY_SETPOINTS 16 // buffered velocity setpoints per stepper, power of 2
+#endif
+
+#if !defined(TS4_VELOCITY_HOLD_US)
+#define TS4_VELOCITY_HOLD_US 20'000 // setpoint underrun: the last speed is held this long, then the stepper ramps down and stops
+#endif
+
+#if !defined(TS4_VELOCITY_IDLE_US)
+#define TS4_VELOCITY_IDLE_US 1'000 // longest interval between two velocity ISRs (standstill, low speeds)
+#endif
+
 namespace TS4
 {
     class StepperBase
@@ -25,25 +54,47 @@ namespace TS4
             target,
             rotate,
             stopping,
+            scurve,   // jerk limited move to target, see scurve.h
+            velocity, // tracks streamed velocity setpoints, see Stepper::streamVelocity
         };
         
         // Add a getter to access the current mode
         mmode_t getMode() const { return mode; }
 
+        enum class rampEngine_t {
+            sqrt,    // v² += 2a per step, frequency from sqrtf (default)
+            integer, // integer period recurrence, see intramp.h
+            tick,    // speed computed at TS4_TICK_HZ by a low priority timer (profiletick.h), the step ISR only reloads the period
+        };
+        rampEngine_t getRampEngine() const { return engine; } // sqrt while a tick move had to fall back
+
      protected:
         StepperBase(const int stepPin, const int dirPin);
 
-        void startMoveTo(int32_t s_tgt, int32_t v_e, uint32_t v_max, uint32_t a);
+        // v_s < 0: continue with the current speed. running: timer of the previous group lead, the move starts on it from
+        // the step ISR without allocating (no new timer, the tick engine falls back to sqrt for the move)
+        void startMoveTo(int32_t s_tgt, int32_t v_e, uint32_t v_max, uint32_t a, int32_t v_s = -1, ITimer* running = nullptr);
         void startRotate(int32_t v_max, uint32_t a);
+        void startSCurve(int32_t s_tgt, uint32_t v_max, uint32_t a, uint32_t j); // falls back to startMoveTo while moving
         void startStopping(int32_t va_end, uint32_t a);
 
 
-        inline void setDir(int d);
+        inline bool setDir(int32_t d); // writes the dir pin only if the level changes, returns true then
         int32_t dir;
         int32_t vDir;
 
+        // direction setup: a step following a change of the dir pin is postponed by the timer instead of busy waiting
+        static constexpr uint32_t dirSetupTicks = TS4_DIR_SETUP_US * (timerClock / 1'000'000);
+        int8_t dirLevel    = -1;    // level written to the dir pin, -1: not yet written
+        bool dirSetup      = false; // dir pin of this or of a dependent stepper changed, the next step has to wait
+        bool stepPostponed = false; // doStep() handed the setup time to the timer, the step is done on its next call
+        bool pinOutput     = false; // the timer drives the step pin, its stepIsr runs a pause ahead of the edge...
+        bool firstStep     = false; // ...except for the first step after start()
+        inline void startTimer();   // starts stpTimer for a new move
+
         volatile int32_t pos = 0;
-        volatile int32_t target;
+        volatile int32_t target = 0;
+        PositionEvents events{&pos}; // checked by doStep() or, for dependent steppers, by the StepBatch of the lead
 
         int32_t s_tgt;
         int32_t v_tgt;
@@ -60,17 +111,109 @@ namespace TS4
 
         const int stepPin, dirPin;
 
-        ITimer* stpTimer;
+        ITimer* stpTimer = nullptr;
+#if defined(TS4_PROFILE)
+        IsrStats stepStats, resetStats;
+#endif
         inline void stepISR();
         inline void rotISR();
         inline void resetISR();
+        inline void finishMove();
+        inline void endMove();          // finishMove without the timer: a group lead handed it over, see StepperGroupBase::startQueued
+        inline void notifyDone();       // move ended: completion of the stepper and of the group move it leads
+        inline MoveToken numberMove(); // token of the move just started, the ISR might have finished it already
+
+        Completion completion;
+        Completion* groupCompletion = nullptr; // set by the group for the lead stepper of a group move
+
+        rampEngine_t engine = rampEngine_t::sqrt;
+        IntRamp ramp;
+        inline void intStepISR();
+        inline void intRotISR();
+
+        SCurve scurve;
+        inline void scurveISR();
+
+        // fixed rate profile (rampEngine_t::tick): profileTick() publishes the period, tickISR() loads it
+        float vTick;                  // speed (steps/s), signed in rotate mode
+        float vExit;                  // target mode: speed at s_tgt
+        volatile uint32_t tickPeriod; // ticks of timerClock
+        volatile int8_t tickDir;      // rotate mode: direction of the published period
+        volatile bool tickDone;       // standstill reached, tickISR() ends the move
+        bool startTick();             // registers profileTick(), falls back to the sqrt engine for this move if that fails
+        bool tickFallback = false;    // engine is sqrt until the move ends, tick was selected
+        inline void endEngine();      // move ended: unregisters the tick, restores the selected engine
+        void profileTick();
+        inline void publishTick();
+        inline void tickISR();
+
+        // velocity streaming: setpoints pushed by the main loop, interpolated and acceleration limited by velocityISR()
+        struct setpoint_t
+        {
+            int32_t v;   // steps/s
+            uint32_t at; // micros() when v is to be reached
+        };
+        RingBuffer<setpoint_t, TS4_VELOCITY_SETPOINTS> setpoints;
+        setpoint_t reached;          // last setpoint passed, start of the interpolation
+        float vNow;                  // current speed (steps/s), signed
+        float phase;                 // fraction of the next step done
+        uint32_t clockUs, clockRest; // time of the ISR in µs (+ ticks), advanced by the loaded periods instead of reading micros()
+        uint32_t lastTicks;          // period loaded by the previous ISR
+        static constexpr uint32_t ticksPerUs = timerClock / 1'000'000;
+        static constexpr uint32_t idleTicks  = TS4_VELOCITY_IDLE_US * ticksPerUs;
+        void startVelocity(uint32_t a);
+        inline void velocityISR();
+        inline float velocitySetpoint(); // interpolated at clockUs, 0 after an underrun
+
+        template <void (StepperBase::*isr)()> // static trampoline for ITimer::attachIsr
+        static void callIsr(void* self) { (static_cast<StepperBase*>(self)->*isr)(); }
+
+        template <void (StepperBase::*isr)()> // same for the step ISRs, completes a postponed step instead of running the ISR
+        static void callStepIsr(void* self)
+        {
+            StepperBase* stepper = static_cast<StepperBase*>(self);
+            if (stepper->stepPostponed)
+            {
+                stepper->stepPostponed = false;
+                stepper->doStep();
+            }
+            else
+                (stepper->*isr)();
+        }
 
         mmode_t mode = mmode_t::target;
 
+        // queued moves, pushed by the main loop, popped by the ISR at the end of the current segment
+        struct segment_t
+        {
+            int32_t target;
+            uint32_t vMax;
+            uint32_t acc;
+        };
+        RingBuffer<segment_t, TS4_QUEUE_SIZE> queue;
+        segment_t segment;    // segment currently executed
+        int32_t segmentStart; // position at the start of the current segment
+
+        bool startQueued();                                 // pops the next segment and starts it, false if the queue is empty
+        void continueQueue();                               // main loop, interrupts disabled: a segment was pushed while moving
+        int64_t exitSpeedSqr(const segment_t* next) const; // junction speed² between the current and the next segment
+        static bool nextQueued(void* self) { return static_cast<StepperBase*>(self)->startQueued(); }
+
+        using segmentHook_t = bool (*)(void* ctx); // starts the next segment from the ISR, returns false if there is none
+        segmentHook_t nextSegment = nullptr;
+        void* nextSegmentCtx      = nullptr;
+
         // Bresenham:
-        StepperBase* next = nullptr; // linked list of steppers, maintained from outside
-        int32_t A, B;                // Bresenham parameters (https://en.wikipedia.org/wiki/Bresenham)
+        StepBatch* batch = nullptr; // dependent steppers of a group move, maintained from outside
+        int32_t A;                  // Bresenham parameter of the lead (https://en.wikipedia.org/wiki/Bresenham)
+        Gearing* gears   = nullptr; // followers geared to this stepper, see gearing.h
+        bool ownsPulse() const { return batch == nullptr && gears == nullptr; } // the timer may drive the step pin
+        StepRecorder* recorder = nullptr; // records the steps of this stepper (and of the group it leads), see recording.h
+        StepPlayer* player     = nullptr; // replays a recording on this stepper, which refuses moves meanwhile (not isMoving)
 
+        friend class Gearing;
+        friend class StepRecorder;
+        friend class StepPlayer;
         friend class StepperGroupBase;
         friend class Stepper; // Add Stepper as a friend class for direct access
     };
@@ -79,28 +222,63 @@ namespace TS4
     // Inline implementation
     //========================================================================================================
 
+    bool StepperBase::setDir(int32_t d)
+    {
+        dir            = d;
+        bool followers = gears != nullptr && gears->setDirection(d); // geared followers reverse with the master
+        int8_t level   = d > 0 ? HIGH : LOW;
+        if (level == dirLevel) return followers;
+        dirLevel = level;
+        digitalWriteFast(dirPin, level);
+        return true;
+    }
+
+    void StepperBase::startTimer()
+    {
+        stepPostponed = false;
+        firstStep     = true;
+        stpTimer->start();
+    }
+
     void StepperBase::doStep()
     {
-        digitalWriteFast(stepPin, HIGH);
+        if (dirSetup)
+        {
+            dirSetup = false;
+            if (firstStep || !pinOutput)
+            {
+                stepPostponed = true;
+                stpTimer->postpone(dirSetupTicks);
+                return;
+            }
+        }
+        firstStep = false;
+
         s += 1;
         pos += dir;
+        TS4_PROFILE_STEP(stepStats);
 
-        StepperBase* stepper = next;
-        while (stepper != nullptr) // move slave motors if required
+        if (batch == nullptr)
+            digitalWriteFast(stepPin, HIGH);
+        else
         {
-            if (stepper->B >= 0)
-            {
-                digitalWriteFast(stepper->stepPin, HIGH);
-                stepper->pos += stepper->dir;
-                stepper->B -= this->A;
-            }
-            stepper->B += stepper->A;
-            stepper = stepper->next;
+            float stretch = batch->step(A); // move slave motors if required, one write per GPIO port
+            if (stretch != 0) stpTimer->scalePeriod(stretch); // arc blocks: the ramp runs at path speed
         }
+        if (gears != nullptr) gears->step();
+        events.stepped(dir);
+        if (recorder != nullptr) recorder->record(stpTimer);
     }
 
     void StepperBase::stepISR()
     {
+        TS4_PROFILE_ISR(stepStats);
+        while (s >= s_tgt && mode == mmode_t::target && nextSegment != nullptr) // segment done, continue with the next one
+        {
+            if (!nextSegment(nextSegmentCtx)) break;
+            if (stpTimer == nullptr) return; // group lead handed over to another stepper
+        }
+
         // Setup phase - handle stopping mode at the start
         if (mode == mmode_t::stopping) {
             // When stopping, always target zero velocity
@@ -123,7 +301,7 @@ namespace TS4
             // In acceleration phase - use twoA to adjust velocity
             v_sqr += twoA;
             v = signum(v_sqr) * sqrtf(std::abs(v_sqr));
-            stpTimer->updateFrequency(std::abs(v));
+            stpTimer->updatePeriod(timerClock / std::max<int32_t>(std::abs(v), 1));
             doStep();
         } 
         else if (s < decStart) { 
@@ -145,14 +323,14 @@ namespace TS4
             }
             
             v = sqrtf(v_sqr);
-            stpTimer->updateFrequency(std::abs(v));
+            stpTimer->updateSpeed(std::max<int32_t>(std::abs(v), 1)); // cruising: keep the fraction of the period
             doStep();
         }
         else if (s < s_tgt) { 
-            // In deceleration phase
-            v_sqr -= twoA;            
+            // In deceleration phase, not slower than the start/stop speed (the last periods would get arbitrarily long)
+            v_sqr = std::max<int64_t>(v_sqr - twoA, 200 * 200);
             v = signum(v_sqr) * sqrtf(std::abs(v_sqr));
-            stpTimer->updateFrequency(std::abs(v));
+            stpTimer->updatePeriod(timerClock / std::max<int32_t>(std::abs(v), 1));
             doStep();
         } 
         else { 
@@ -162,23 +340,13 @@ namespace TS4
                 target = pos;
             }
             
-            stpTimer->stop();
-            TimerFactory::returnTimer(stpTimer);
-            stpTimer = nullptr;
-            
-            auto *cur = this;
-            while (cur != nullptr) {
-                auto *tmp = cur->next;
-                cur->next = nullptr;
-                cur = tmp;
-            }
-            
-            isMoving = false;
+            finishMove();
         }
     }
 
     void StepperBase::rotISR()
     {
+        TS4_PROFILE_ISR(stepStats);
         // Set to rotate mode unless we're stopping
         if (mode != mmode_t::stopping) {
             mode = mmode_t::rotate;
@@ -200,18 +368,7 @@ namespace TS4
                     target = pos;
                     
                     // Clean up and stop
-                    stpTimer->stop();
-                    TimerFactory::returnTimer(stpTimer);
-                    stpTimer = nullptr;
-                    
-                    auto *cur = this;
-                    while (cur != nullptr) {
-                        auto *tmp = cur->next;
-                        cur->next = nullptr;
-                        cur = tmp;
-                    }
-                    
-                    isMoving = false;
+                    finishMove();
                     return;
                 }
             } else {
@@ -219,24 +376,20 @@ namespace TS4
                 v_sqr += vDir * twoA;
             }
 
-            dir = signum(v_sqr);
-            digitalWriteFast(dirPin, dir > 0 ? HIGH : LOW);
-            delayMicroseconds(5);
+            if (setDir(signum(v_sqr))) dirSetup = true;
 
             v_abs = sqrtf(std::abs(v_sqr));
-            stpTimer->updateFrequency(v_abs);
+            stpTimer->updatePeriod(timerClock / std::max<int32_t>(v_abs, 200)); // ramp through zero at the start/stop speed
             doStep();
         } 
         else // At target speed
         {
-            dir = signum(v_sqr);
-            digitalWriteFast(dirPin, dir > 0 ? HIGH : LOW);
-            delayMicroseconds(5);
+            if (setDir(signum(v_sqr))) dirSetup = true;
 
             if (v_tgt != 0 || mode != mmode_t::stopping)
             {
                 v_abs = sqrtf(std::abs(v_sqr));
-                stpTimer->updateFrequency(v_abs);
+                stpTimer->updateSpeed(std::max<int32_t>(v_abs, 1));
                 doStep();
             } 
             else // We're at target speed of 0 or stopping mode reached 0
@@ -244,33 +397,239 @@ namespace TS4
                 // Update target to current position since we're stopping here
                 target = pos;
                 
-                stpTimer->stop();
-                TimerFactory::returnTimer(stpTimer);
-                stpTimer = nullptr;
                 v_sqr = 0;
+                finishMove();
+            }
+        }
+    }
 
-                auto *cur = this;
-                while (cur != nullptr) {
-                    auto *tmp = cur->next;
-                    cur->next = nullptr;
-                    cur = tmp;
-                }
-                
-                isMoving = false;
+    void StepperBase::intStepISR()
+    {
+        TS4_PROFILE_ISR(stepStats);
+        while (s >= s_tgt && mode == mmode_t::target && nextSegment != nullptr) // segment done, continue with the next one
+        {
+            if (!nextSegment(nextSegmentCtx)) break;
+            if (stpTimer == nullptr) return; // group lead handed over to another stepper
+        }
+
+        if (mode == mmode_t::stopping && s < decStart) // decelerate immediately
+        {
+            ramp.setExit(0);
+            accEnd   = s;
+            decStart = s;
+            s_tgt    = s + ramp.m - ramp.mMin;
+        }
+
+        if (s < accEnd)
+        {
+            ramp.accelerate();
+        }
+        else if (s < decStart)
+        {
+            ramp.approach(); // target speed might have been changed by overrideSpeed
+        }
+        else if (s < s_tgt)
+        {
+            ramp.decelerate();
+        }
+        else
+        {
+            if (mode == mmode_t::stopping) target = pos;
+            finishMove();
+            return;
+        }
+        stpTimer->updatePeriod(ramp.period, ramp.frac);
+        doStep();
+    }
+
+    void StepperBase::intRotISR()
+    {
+        TS4_PROFILE_ISR(stepStats);
+        bool stopping = v_tgt == 0 || mode == mmode_t::stopping;
+
+        if (stopping || signum(v_tgt) != dir) // stopping or reversing
+        {
+            if (ramp.m > ramp.mMin)
+            {
+                ramp.decelerate();
             }
+            else if (stopping)
+            {
+                target = pos;
+                finishMove();
+                return;
+            }
+            else // reached start speed, reverse
+            {
+                if (setDir(-dir)) dirSetup = true;
+            }
+        }
+        else
+        {
+            ramp.approach();
         }
+        stpTimer->updatePeriod(ramp.period, ramp.frac);
+        doStep();
     }
 
-    void StepperBase::resetISR()
+    void StepperBase::scurveISR()
+    {
+        TS4_PROFILE_ISR(stepStats);
+        if (mode == mmode_t::stopping) scurve.stop();
+
+        if (s >= s_tgt && mode == mmode_t::scurve && nextSegment != nullptr && nextSegment(nextSegmentCtx)) return; // queued moves follow trapezoidal
+
+        if (s >= s_tgt || scurve.done())
+        {
+            if (mode == mmode_t::stopping) target = pos;
+            finishMove();
+            return;
+        }
+        scurve.step(s);
+        stpTimer->updatePeriod(scurve.period);
+        doStep();
+    }
+
+    float StepperBase::velocitySetpoint()
+    {
+        setpoint_t* next = setpoints.peek();
+        while (next != nullptr && (int32_t)(clockUs - next->at) >= 0)
+        {
+            setpoints.pop(reached);
+            next = setpoints.peek();
+        }
+
+        int32_t since = clockUs - reached.at;
+        if (next == nullptr) return since < TS4_VELOCITY_HOLD_US ? reached.v : 0;
+        return reached.v + (next->v - reached.v) * ((float)since / (int32_t)(next->at - reached.at));
+    }
+
+    void StepperBase::velocityISR()
+    {
+        TS4_PROFILE_ISR(stepStats);
+        float dt = lastTicks * (1.0f / timerClock);
+        clockRest += lastTicks;
+        clockUs += clockRest / ticksPerUs;
+        clockRest %= ticksPerUs;
+
+        phase += std::abs(vNow) * dt;
+        bool due = phase > 0.999f; // the previous ISR scheduled this one for the step, allow for rounding
+        if (due) phase = std::max(0.0f, phase - 1.0f);
+
+        float vSet   = mode == mmode_t::stopping ? 0.0f : velocitySetpoint();
+        bool ending  = mode == mmode_t::stopping || (setpoints.empty() && (int32_t)(clockUs - reached.at) >= TS4_VELOCITY_HOLD_US);
+        float dv     = twoA * 0.5f * dt;
+        float vNew   = vNow + constrain(vSet - vNow, -dv, dv);
+        if (vNow * vNew < 0) vNew = 0; // reverse from standstill
+
+        if (vNew == 0 && ending && !due)
+        {
+            target = pos;
+            finishMove();
+            return;
+        }
+        if (vNow == 0 && vNew != 0) // starting: from a full step, the dir pin might change
+        {
+            phase = 0;
+            if (setDir(vNew > 0 ? 1 : -1)) dirSetup = true;
+        }
+
+        uint32_t ticks = idleTicks;
+        if (vNew != 0)
+        {
+            float t = (1.0f - phase) / std::abs(vNew) * timerClock; // until the next step
+            if (t < idleTicks) ticks = std::max<uint32_t>(t, 1);
+        }
+        lastTicks = ticks;
+        vNow      = vNew;
+        stpTimer->updatePeriod(ticks);
+        if (due) doStep();
+    }
+
+    void StepperBase::publishTick()
     {
-        // Serial.println("r");
-        // Serial.flush();
-        StepperBase* stepper = this;
-        while (stepper != nullptr)
+        float v    = std::abs(vTick);
+        v_sqr      = (int64_t)(vTick * v); // signed in rotate mode, same as the per step engines
+        tickPeriod = timerClock / std::max(v, 1.0f);
+        tickDir    = vTick >= 0 ? 1 : -1;
+    }
+
+    void StepperBase::tickISR()
+    {
+        TS4_PROFILE_ISR(stepStats);
+        while (s >= s_tgt && mode == mmode_t::target && nextSegment != nullptr) // segment done, continue with the next one
         {
-            digitalWriteFast(stepper->stepPin, LOW);
-            stepper = stepper->next;
+            if (!nextSegment(nextSegmentCtx)) break;
+            if (stpTimer == nullptr) return; // group lead handed over to another stepper
         }
+
+        if (tickDone || (mode == mmode_t::target && s >= s_tgt))
+        {
+            if (mode != mmode_t::target) target = pos;
+            finishMove();
+            return;
+        }
+        if (mode == mmode_t::rotate && tickDir != dir)
+        {
+            if (setDir(tickDir)) dirSetup = true;
+        }
+        stpTimer->updatePeriod(tickPeriod);
+        doStep();
+    }
+
+    void StepperBase::finishMove()
+    {
+        stpTimer->stop();
+        TimerFactory::returnTimer(stpTimer);
+        endMove();
+    }
+
+    void StepperBase::endMove()
+    {
+        stpTimer      = nullptr;
+        stepPostponed = false;
+        RampCache::release(ramp.table);
+        ramp.useTable(nullptr);
+        endEngine();
+        nextSegment = nullptr;
+        batch       = nullptr;
+
+        isMoving = false;
+        notifyDone();
+    }
+
+    void StepperBase::endEngine()
+    {
+        if (engine == rampEngine_t::tick) ProfileTick::remove(this);
+        if (tickFallback) engine = rampEngine_t::tick;
+        tickFallback = false;
+    }
+
+    void StepperBase::notifyDone()
+    {
+        Completion* group = groupCompletion; // a callback might start the next move
+        groupCompletion   = nullptr;
+
+        completion.finish();
+        if (group != nullptr) group->finish();
+    }
+
+    MoveToken StepperBase::numberMove()
+    {
+        noInterrupts();
+        MoveToken token = completion.begin(isMoving);
+        interrupts();
+        return token;
+    }
+
+    void StepperBase::resetISR()
+    {
+        TS4_PROFILE_ISR(resetStats);
+        if (batch == nullptr)
+            digitalWriteFast(stepPin, LOW);
+        else
+            batch->reset();
+        if (gears != nullptr) gears->reset();
     }
 }
 #pragma pop_macro("abs")
\ No newline at end of file
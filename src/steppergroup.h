@@ -2,7 +2,6 @@
 #include "stepper.h"
 #include "steppergroupbase.h"
 #include <algorithm>
-#include <vector>
 
 namespace TS4
 {
@@ -14,47 +13,54 @@ namespace TS4
         StepperGroup(Stepper* arr[], size_t n) { add(arr, n); }
         StepperGroup(std::initializer_list<std::reference_wrapper<Stepper>> stepperList) { add(stepperList); }
 
-        // add and remove steppers ----------------------------------------------------------------------------
-        void add(Stepper& s) { add(&s); }
-        void add(Stepper* s) { steppers.push_back(s); }
+        // add and remove steppers (up to TS4_MAX_GROUP_SIZE) ---------------------------------------------
+        // adding more returns false and the group refuses to move until clear(), it would leave steppers behind
+        bool add(Stepper& s) { return add(&s); }
+        bool add(Stepper* s)
+        {
+            if (nrSteppers >= TS4_MAX_GROUP_SIZE)
+            {
+                overfull = true;
+                return false;
+            }
+            steppers[nrSteppers++] = s;
+            return true;
+        }
 
-        void add(std::initializer_list<std::reference_wrapper<Stepper>> stepperList)
+        bool add(std::initializer_list<std::reference_wrapper<Stepper>> stepperList)
         {
+            bool all = true;
             for (auto& s : stepperList)
             {
-                add(s.get());
+                all &= add(s.get());
             }
+            return all;
         }
 
-        void add(Stepper* arr[], size_t n)
+        bool add(Stepper* arr[], size_t n)
         {
+            bool all = true;
             for (unsigned i = 0; i < n; i++)
             {
-                add(arr[i]);
+                all &= add(arr[i]);
             }
+            return all;
         }
 
         void remove(Stepper& s) { remove(&s); }
-        void remove(Stepper* s) { steppers.erase(std::remove(steppers.begin(), steppers.end(), s), steppers.end()); }
+        void remove(Stepper* s) { nrSteppers = std::remove(steppers, steppers + nrSteppers, s) - steppers; }
 
-        void clear() { steppers.clear(); }
+        void clear()
+        {
+            nrSteppers = 0;
+            overfull   = false;
+        }
 
 
 
         void move()
         {
-            startMove(); // start movement in the background
-            while (1)    // wait until all steppers have stopped
-            {
-                delay(1);
-                bool done = true;
-                for (auto stepper : steppers)
-                {
-                    if (stepper->isMoving)
-                        done = false;
-                }
-                if (done) break;
-            }
+            startMove().wait(); // until all steppers have stopped
         }
 
         // void rotateAsync(int32_t v1, int32_t, v2)
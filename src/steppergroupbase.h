@@ -4,81 +4,113 @@
 #pragma push_macro("abs")
 #undef abs
 
+#include "planner.h"
 #include "stepper.h"
-#include <vector>
+#include "stepstream.h"
 
 namespace TS4
 {
     class StepperGroupBase
     {
      public:
-        void startMove()
+        MoveToken startMove() // the token is done when all steppers of the group stopped
         {
-            if (steppers.empty()) return;
+            if (!setupMove()) return MoveToken();
+            leadStepper->batch           = &batch;
+            leadStepper->groupCompletion = &completion;
+            activeEndsMove               = true;
+            float v = std::abs(leadStepper->vMax), a = leadStepper->acc;
+            if (planner.feedRate > 0 || planner.feedAcc > 0) feedLimits(v, a);
+            leadStepper->startMoveTo(leadStepper->target, 0, lroundf(v), lroundf(a)); // start lead stepper
+            return numberMove();
+        }
 
+        // outputs the move to the current targets as a precomputed step stream (e.g. timer triggered DMA) instead of
+        // step interrupts. All step pins must be on the same GPIO port, returns false if not or if something is running
+        bool startStream(IStreamBackend& backend)
+        {
+            if (backend.isRunning() || (leadStepper != nullptr && leadStepper->isMoving)) return false;
+            if (!setupMove() || batch.ports() != 1) return false;
 
-            auto deltaSorter = [](Stepper* a, Stepper* b) { return std::abs(a->target - a->pos) > std::abs(b->target - b->pos); };
+            int32_t delta = leadStepper->target - leadStepper->pos;
+            if (leadStepper->setDir(delta >= 0 ? 1 : -1)) leadStepper->dirSetup = true;
 
-            std::vector<Stepper*> sorted = steppers;              // copy stepper list..
-            std::sort(sorted.begin(), sorted.end(), deltaSorter); // ...and sort by "steps to do"
+            for (unsigned i = 0; i < nrSteppers; i++)
+            {
+                if (steppers[i]->recorder != nullptr) steppers[i]->recorder->reject(); // no step ISR to record from
+            }
+            uint32_t leadIn = leadStepper->dirSetup ? StepperBase::dirSetupTicks : 0; // the stream starts with a pause instead
+            leadStepper->dirSetup = false;
+            backend.stream.begin(batch, &leadStepper->pos, leadStepper->dir, leadStepper->A, std::abs(leadStepper->vMax), leadStepper->acc, leadIn);
+            return backend.start();
+        }
 
-            leadStepper = sorted[0]; // this stepper will lead the movement, steps of the other motors are calculated by Bresenham algorithm
+        MoveToken startRotate()
+        {
+            if (nrSteppers == 0 || overfull || replaying()) return MoveToken();
 
-            leadStepper->A       = std::abs(leadStepper->target - leadStepper->pos);
-            //  SerialUSB1.printf("%s tgt:%d A:%d B:%d\n", leadStepper->name.c_str(), leadStepper->target, leadStepper->A, leadStepper->B);
-            // //
+            unsigned lead = 0; // fastest stepper leads the movement, steps of the other motors are calculated by Bresenham algorithm
+            for (unsigned i = 1; i < nrSteppers; i++)
+            {
+                if (steppers[i]->vMax > steppers[lead]->vMax) lead = i;
+            }
+            leadStepper    = steppers[lead];
+            leadStepper->A = std::abs(leadStepper->vMax);
 
-            for (unsigned i = 1; i < sorted.size(); i++) // loop through the dependent motors
+            batch.begin(leadStepper->stepPin);
+            for (unsigned i = 0; i < nrSteppers; i++) // loop through the dependent motors
             {
-                Stepper* stepper    = sorted[i];                       //
-                int32_t delta       = stepper->target - stepper->pos;  //
-                sorted[i - 1]->next = stepper;                         // set up linked list
-                stepper->A          = std::abs(delta);                 //
-                stepper->B          = 2 * stepper->A - leadStepper->A; // set bresenham params for dependent steppers
-                stepper->dir        = (delta >= 0) ? 1 : -1;
-                digitalWriteFast(stepper->dirPin, delta >= 0 ? HIGH : LOW);
-                // SerialUSB1.printf("%s tgt:%d A:%d B:%d\n", stepper->name.c_str(), stepper->target, stepper->A, stepper->B);
-                // SerialUSB1.flush();
-            }                                    //
-            sorted[sorted.size() - 1]->next = nullptr; // end of linked list
-            leadStepper->startMoveTo(leadStepper->target, 0, std::abs(leadStepper->vMax), leadStepper->acc );              // start lead stepper
+                if (i == lead) continue;
+                Stepper* stepper = steppers[i];             //
+                int32_t A        = std::abs(stepper->vMax); //
+                if (stepper->setDir(stepper->vMax >= 0 ? 1 : -1)) leadStepper->dirSetup = true; // first step waits for the setup time
+                batch.addSlave(stepper->stepPin, &stepper->pos, A, 2 * A - leadStepper->A, stepper->dir, &stepper->events); // set bresenham params for dependent steppers
+                //Serial.printf("r %s vMax:%d A:%d B:%d\n", stepper->name.c_str(), stepper->vMax, stepper->A, stepper->B);
+            }
+            leadStepper->batch           = &batch;
+            leadStepper->groupCompletion = &completion;
+            activeEndsMove               = true;
+            leadStepper->rotateAsync();              // start lead stepper
+            return numberMove();
         }
 
-        void startRotate()
-        {
-            if (steppers.empty()) return;
+        // appends a move to the current targets (setTargetAbs) of all steppers, starts immediately if idle
+        // returns false if the queue is full, the group is empty or overfull or one of its steppers replays a recording
+        bool queueMove() { return enqueue(nullptr); }
 
-            //SerialUSB1.println("srot");
+        // appends a circular arc around (centerX, centerY) in the plane of the steppers with index axisX and axisY to the
+        // current targets, the other steppers move linearly along (helix). The plane axes end on the circle, a short straight
+        // move corrects a target off the circle. A target on the start angle gives a full circle. Needs up to 10 free
+        // queue entries, returns false if they are not available
+        bool queueArc(int32_t centerX, int32_t centerY, bool ccw, unsigned axisX = 0, unsigned axisY = 1)
+        {
+            if (axisX >= nrSteppers || axisY >= nrSteppers || axisX == axisY) return false;
+            ArcSpec arc{{centerX, centerY}, {(uint8_t)axisX, (uint8_t)axisY}, ccw};
+            return enqueue(&arc);
+        }
 
-            auto deltaSorter = [](Stepper* a, Stepper* b) { return a->vMax > b->vMax; };
+        // speed (steps/s) and acceleration (steps/s^2) along the path of group moves, the axis limits still apply
+        // 0: moves are limited by the axes only (startMove runs the lead stepper at its own vMax and acc)
+        void setFeedRate(float v, float a = 0)
+        {
+            planner.feedRate = v;
+            planner.feedAcc  = a;
+        }
 
-            // SerialUSB1.printf("0: %s %d, 1: %s %d\n", steppers[0]->name.c_str(), steppers[0]->vMax, steppers[1]->name.c_str(), steppers[1]->vMax);
-            // SerialUSB1.flush();
+        void setJunctionDeviation(float steps) { planner.junctionDeviation = steps; } // cornering tolerance of queued paths
 
-            std::vector<Stepper*> sorted = steppers;              // copy stepper list..
-            std::sort(sorted.begin(), sorted.end(), deltaSorter); // ...and sort by "steps to do"
+        unsigned queuedMoves() const { return planner.size(); }
 
-            leadStepper = sorted[0]; // this stepper will lead the movement, steps of the other motors are calculated by Bresenham algorithm
-            leadStepper->A       = std::abs(leadStepper->vMax);
-
-            //
-            for (unsigned i = 1; i < sorted.size(); i++) // loop through the dependent motors
-            {
-                Stepper* stepper    = sorted[i];                          //
-                sorted[i - 1]->next = stepper;                            // set up linked list
-                stepper->A          = std::abs(stepper->vMax); //
-                stepper->B          = 2 * stepper->A - leadStepper->A;    // set bresenham params for dependent steppers
-                stepper->dir        = (stepper->vMax >= 0) ? 1 : -1;
-                digitalWriteFast(stepper->dirPin, stepper->dir >= 0 ? HIGH : LOW);
-                //Serial.printf("r %s vMax:%d A:%d B:%d\n", stepper->name.c_str(), stepper->vMax, stepper->A, stepper->B);
-            }                                    //
-            sorted[sorted.size() - 1]->next = nullptr; // end of linked list
-            leadStepper->rotateAsync();              // start lead stepper
-        }
+        // cb(ctx) is called when the group stops, from the step ISR of the lead stepper or, if deferred, from TS4::handleEvents()
+        void onDone(isr_t cb, void* ctx = nullptr, bool deferred = false) { completion.setCallback(cb, ctx, deferred); }
+        MoveToken lastMove() const { return completion.last(); } // token of the latest started or queued move
 
         void stopAsync()
         {
             leadStepper->stopAsync();
+            noInterrupts(); // ISR doesn't pop while stopping
+            planner.clear();
+            interrupts();
         }
 
         void overrideSpeed(float f)
@@ -91,9 +123,213 @@ namespace TS4
 
 
      protected:
-        std::vector<Stepper*> steppers;
+        Stepper* steppers[TS4_MAX_GROUP_SIZE]; // inline storage, groups built on the fly don't allocate
+        unsigned nrSteppers = 0;
+        bool overfull       = false; // more steppers were added than fit, moves are refused
+
+        Stepper* leadStepper = nullptr;
+        StepBatch batch; // Bresenham state and step pin ports of the dependent steppers
+
+        // move queue
+        PathPlanner planner;
+        PathBlock active; // block currently executed
+        float exitSqr = 0; // exit speed² (path) the running block was planned for
+        bool activeEndsMove = true; // the running block is the last one of a move, its end finishes a token
 
-        Stepper* leadStepper;
+        Completion completion; // finished by the lead stepper (groupCompletion) when the group stops
+
+        MoveToken numberMove() // token of the move just started, see StepperBase::numberMove
+        {
+            noInterrupts();
+            MoveToken token = completion.begin(leadStepper->isMoving);
+            interrupts();
+            return token;
+        }
+
+        bool replaying() const // a StepPlayer drives one of the steppers, moves are refused
+        {
+            for (unsigned i = 0; i < nrSteppers; i++)
+            {
+                if (steppers[i]->player != nullptr) return true;
+            }
+            return false;
+        }
+
+        // selects the lead stepper, sets up the Bresenham batch and the directions of the dependent steppers
+        bool setupMove()
+        {
+            if (nrSteppers == 0 || overfull || replaying()) return false;
+
+            // the stepper with the most steps to do leads the movement, a single pass, the order of the dependents doesn't matter
+            unsigned lead     = 0;
+            int32_t leadSteps = std::abs(steppers[0]->target - steppers[0]->pos);
+            for (unsigned i = 1; i < nrSteppers; i++)
+            {
+                int32_t steps = std::abs(steppers[i]->target - steppers[i]->pos);
+                if (steps > leadSteps)
+                {
+                    lead      = i;
+                    leadSteps = steps;
+                }
+            }
+            leadStepper    = steppers[lead];
+            leadStepper->A = leadSteps;
+
+            batch.begin(leadStepper->stepPin);
+            for (unsigned i = 0; i < nrSteppers; i++) // loop through the dependent motors
+            {
+                if (i == lead) continue;
+                Stepper* stepper = steppers[i];                    //
+                int32_t delta    = stepper->target - stepper->pos; //
+                int32_t A        = std::abs(delta);
+                if (stepper->setDir(delta >= 0 ? 1 : -1)) leadStepper->dirSetup = true;
+                batch.addSlave(stepper->stepPin, &stepper->pos, A, 2 * A - leadStepper->A, stepper->dir, &stepper->events); // set bresenham params for dependent steppers
+                // SerialUSB1.printf("%s tgt:%d A:%d B:%d\n", stepper->name.c_str(), stepper->target, stepper->A, stepper->B);
+                // SerialUSB1.flush();
+            }
+            return true;
+        }
+
+        bool enqueue(const ArcSpec* arc) // queueMove, queueArc
+        {
+            unsigned n = nrSteppers;
+            if (n == 0 || overfull || replaying()) return false;
+
+            int32_t target[TS4_MAX_GROUP_SIZE];
+            uint32_t vMax[TS4_MAX_GROUP_SIZE], acc[TS4_MAX_GROUP_SIZE];
+            for (unsigned i = 0; i < n; i++)
+            {
+                target[i] = steppers[i]->target;
+                vMax[i]   = std::abs(steppers[i]->vMax);
+                acc[i]    = steppers[i]->acc;
+            }
+
+            bool idle = leadStepper == nullptr || !leadStepper->isMoving;
+            bool runningQueue = !idle && leadStepper->nextSegment == nextQueued;
+            if (planner.size() == 0 && !runningQueue) // new path, starts at the current (or currently targeted) positions
+            {
+                int32_t start[TS4_MAX_GROUP_SIZE];
+                for (unsigned i = 0; i < n; i++) start[i] = idle ? steppers[i]->pos : steppers[i]->target;
+                planner.reset(start, n);
+            }
+            if (!(arc == nullptr ? planner.add(target, vMax, acc) : planner.addArc(target, vMax, acc, *arc))) return false;
+
+            noInterrupts();
+            completion.begin();
+            idle = leadStepper == nullptr || !leadStepper->isMoving;
+            if (idle)
+            {
+                planner.backwardPass();
+                planner.forwardPass(0);
+            }
+            else if (leadStepper->nextSegment == nullptr) // running move was not started from the queue, continue with the queue afterwards
+            {
+                planner.backwardPass();
+                planner.forwardPass(0);
+                leadStepper->nextSegment    = nextQueued;
+                leadStepper->nextSegmentCtx = this;
+            }
+            else if (leadStepper->nextSegment == nextQueued)
+            {
+                float headSqr = planner.backwardPass();
+                if (headSqr > exitSqr && leadStepper->mode == StepperBase::mmode_t::target && leadStepper->s < leadStepper->decStart) // re-plan the running block to a faster exit
+                {
+                    Stepper* lead   = leadStepper;
+                    float f         = active.leadRatio;
+                    int64_t vLead   = lead->engine == StepperBase::rampEngine_t::integer ? lead->ramp.vSqr() : lead->v_sqr;
+                    float reachSqr  = (vLead + 2.0f * active.acc * f * (lead->s_tgt - lead->s)) / (f * f); // path speed² reachable at the end
+                    exitSqr         = std::min(headSqr, reachSqr);
+                    lead->startMoveTo(active.target[active.lead], sqrtf(exitSqr) * f, lroundf(active.vMax * f), lroundf(active.acc * f));
+                }
+                planner.forwardPass(exitSqr);
+            }
+            interrupts();
+
+            if (idle) startQueued();
+            return true;
+        }
+
+        // lead speed and acceleration of startMove from the feed rate, the path limits of all axes projected onto the lead
+        void feedLimits(float& vLead, float& aLead)
+        {
+            float lengthSqr = 0;
+            for (unsigned i = 0; i < nrSteppers; i++)
+            {
+                float d = steppers[i]->target - steppers[i]->pos;
+                lengthSqr += d * d;
+            }
+            if (lengthSqr == 0) return;
+
+            float length = sqrtf(lengthSqr);
+            float v      = planner.feedRate > 0 ? planner.feedRate : INFINITY;
+            float a      = planner.feedAcc > 0 ? planner.feedAcc : INFINITY;
+            for (unsigned i = 0; i < nrSteppers; i++)
+            {
+                int32_t d = std::abs(steppers[i]->target - steppers[i]->pos);
+                if (d == 0) continue;
+                v = std::min(v, std::abs(steppers[i]->vMax) * length / d);
+                a = std::min(a, steppers[i]->acc * length / d);
+            }
+            float f = leadStepper->A / length; // lead steps per path step
+            vLead   = v * f;
+            aLead   = a * f;
+        }
+
+        static bool nextQueued(void* group) { return static_cast<StepperGroupBase*>(group)->startQueued(); }
+
+        // pops the next block and sets up the Bresenham batch, called from the lead ISR: no allocation, a new lead continues on the timer of the old one
+        bool startQueued()
+        {
+            PathBlock blk;
+            if (!planner.pop(blk)) return false;
+
+            unsigned n    = nrSteppers;
+            unsigned lead = blk.lead;
+
+            if (leadStepper != nullptr && leadStepper->isMoving && activeEndsMove) completion.advance(); // the previous move is done
+            activeEndsMove = blk.endsMove;
+
+            ITimer* running = nullptr;
+            if (leadStepper != nullptr && leadStepper != steppers[lead] && leadStepper->isMoving) // lead changes, the new one takes over the running timer
+            {
+                running                      = leadStepper->stpTimer;
+                leadStepper->groupCompletion = nullptr; // the group continues
+                leadStepper->endMove();
+            }
+            leadStepper                  = steppers[lead];
+            leadStepper->groupCompletion = &completion;
+            active                       = blk;
+
+            leadStepper->A = std::abs(blk.target[lead] - leadStepper->pos);
+            batch.begin(leadStepper->stepPin);
+            for (unsigned i = 0; i < n; i++) // dependent motors
+            {
+                if (i == lead || (blk.rSqr != 0 && i == blk.minor)) continue;
+                Stepper* stepper = steppers[i];
+                int32_t delta    = blk.target[i] - stepper->pos;
+                int32_t A        = std::abs(delta);
+                if (stepper->setDir(delta >= 0 ? 1 : -1)) leadStepper->dirSetup = true; // the lead postpones its next step
+                batch.addSlave(stepper->stepPin, &stepper->pos, A, 2 * A - leadStepper->A, stepper->dir, &stepper->events);
+            }
+            if (blk.rSqr != 0) // arc piece, the minor plane axis follows the circle
+            {
+                Stepper* minor = steppers[blk.minor];
+                int32_t dv     = signum(blk.target[blk.minor] - minor->pos);
+                int32_t du     = blk.target[lead] >= leadStepper->pos ? 1 : -1;
+                if (dv != 0 && minor->setDir(dv)) leadStepper->dirSetup = true;
+                batch.setArc(minor->stepPin, &minor->pos, leadStepper->pos - blk.center[0], minor->pos - blk.center[1], du, dv, blk.rSqr, &minor->events);
+            }
+            leadStepper->batch = &batch;
+
+            PathBlock* next = planner.peek();
+            exitSqr         = next != nullptr ? next->entrySqr : 0;
+
+            float f = blk.leadRatio; // path speeds to lead axis speeds
+            leadStepper->nextSegment    = nextQueued;
+            leadStepper->nextSegmentCtx = this;
+            leadStepper->startMoveTo(blk.target[lead], sqrtf(exitSqr) * f, lroundf(blk.vMax * f), lroundf(blk.acc * f), sqrtf(blk.entrySqr) * f, running); // rounded: the ramp cache matches acc exactly
+            return true;
+        }
     };
 }
 
@@ -0,0 +1,126 @@
+#include "stepstream.h"
+#include <algorithm>
+
+namespace TS4
+{
+    void StepStream::setTiming(unsigned tickShift, uint32_t _maxInterval)
+    {
+        shift       = tickShift;
+        maxInterval = _maxInterval;
+    }
+
+    void StepStream::begin(const StepBatch& batch, volatile int32_t* _leadPos, int32_t _leadDir, int32_t leadSteps, uint32_t vMax, uint32_t acc, uint32_t leadIn)
+    {
+        nrSlaves = batch.nrSlaves;
+        std::copy(batch.slaves, batch.slaves + nrSlaves, slaves);
+        leadMask = batch.leadBit();
+        leadPos  = _leadPos;
+        leadDir  = _leadDir;
+        leadA    = leadSteps;
+#if defined(TS4_HOST)
+        pinBase = batch.portBase();
+#else
+        toggleReg = batch.toggleRegister();
+#endif
+
+        // same profile as StepperBase::startMoveTo from standstill to standstill
+        int32_t twoA      = 2 * acc;
+        int64_t v0_sqr    = 200 * 200;
+        int64_t vMax_sqr  = std::max<int64_t>((int64_t)vMax * vMax, v0_sqr);
+        int64_t accLength = (vMax_sqr - v0_sqr) / twoA + 1;
+        if (2 * accLength > leadSteps) accLength = leadSteps / 2;
+
+        s        = 0;
+        sTgt     = leadSteps;
+        accEnd   = accLength - 1;
+        decStart = leadSteps - accLength;
+        ramp.useTable(nullptr);
+        ramp.start(v0_sqr, twoA, vMax);
+
+        toggle      = 0; // frames without toggles for the lead in
+        rest        = leadIn & ((1u << shift) - 1);
+        remaining   = leadIn >> shift;
+        fallPending = false;
+    }
+
+    void StepStream::prime()
+    {
+        refill(0);
+        refill(1);
+    }
+
+    void StepStream::refill(unsigned half)
+    {
+        StepFrame* f = frames + half * halfFrames;
+        valid[half]  = generate(f, halfFrames);
+
+        uint32_t idle = std::max<uint32_t>(1, pulse >> shift); // the output might run past the end until the backend stops it
+        for (unsigned i = valid[half]; i < halfFrames; i++) f[i] = {0, idle};
+    }
+
+    uint32_t StepStream::nextStep()
+    {
+        if (s < accEnd)
+            ramp.accelerate();
+        else if (s < decStart)
+            ramp.approach();
+        else
+            ramp.decelerate();
+
+        uint32_t bits = leadMask;
+        *leadPos += leadDir;
+        for (unsigned i = 0; i < nrSlaves; i++)
+        {
+            SlaveAxis& slave = slaves[i];
+            if (slave.B >= 0)
+            {
+                bits |= slave.mask;
+                *slave.pos += slave.dir;
+                slave.B -= leadA;
+            }
+            slave.B += slave.A;
+        }
+        s++;
+        return bits;
+    }
+
+    unsigned StepStream::generate(StepFrame* f, unsigned n)
+    {
+        unsigned i = 0;
+        while (i < n)
+        {
+            if (remaining == 0) // next pulse or pause
+            {
+                uint32_t ticks;
+                if (fallPending)
+                {
+                    toggle      = fallMask;
+                    ticks       = fallTicks;
+                    fallPending = false;
+                }
+                else if (s < sTgt)
+                {
+                    toggle      = nextStep();
+                    ticks       = pulse;
+                    fallMask    = toggle;
+                    fallTicks   = ramp.period > 2 * pulse ? ramp.period - pulse : pulse;
+                    fallPending = true;
+                }
+                else
+                {
+                    break;
+                }
+
+                ticks += rest;
+                rest      = ticks & ((1u << shift) - 1);
+                remaining = std::max<uint32_t>(1, ticks >> shift);
+            }
+
+            uint32_t t = std::min(remaining, maxInterval);
+            f[i++]     = {toggle, t};
+            toggle     = 0;
+            remaining -= t;
+        }
+        return i;
+    }
+}
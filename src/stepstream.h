@@ -0,0 +1,92 @@
+#pragma once
+
+#include "intramp.h"
+#include "stepbatch.h"
+#include <cstdint>
+
+#if !defined(TS4_STREAM_FRAMES)
+#define TS4_STREAM_FRAMES 128 // frames per half of the stream double buffer
+#endif
+
+namespace TS4
+{
+    struct StepFrame
+    {
+        uint32_t toggle;   // step pin bits (one GPIO port) to toggle at the start of the frame
+        uint32_t interval; // duration of the frame in backend ticks (timerClock >> tickShift)
+    };
+
+    /**
+     * Precomputed step pulse stream of a group move
+     * Runs the integer ramp of the lead stepper and the Bresenham update of the dependent steppers ahead of
+     * time and writes the result as (toggle mask, interval) frames into a double buffer. Every step is a
+     * pulse frame and a pause frame toggling the same bits, intervals longer than the backend supports are
+     * split into frames without toggles. The backend plays one half while the other one is refilled, so the
+     * CPU only runs once per TS4_STREAM_FRAMES frames instead of twice per step.
+     * All step pins must be on the same GPIO port. Positions are updated when frames are generated, i.e. they
+     * run ahead of the output by up to two buffer halves. Position events don't fire for streamed moves.
+     **/
+    class StepStream
+    {
+     public:
+        static constexpr unsigned halfFrames = TS4_STREAM_FRAMES;
+
+        void begin(const StepBatch& batch, volatile int32_t* leadPos, int32_t leadDir, int32_t leadSteps, uint32_t vMax, uint32_t acc,
+                   uint32_t leadIn = 0); // leadIn: timerClock ticks before the first step (direction setup time)
+        void setTiming(unsigned tickShift, uint32_t maxInterval); // set by the backend before begin()
+
+        void prime();              // fills both halves, called by the backend before output starts
+        void refill(unsigned half); // half was output completely, generate the next frames into it (backend ISR)
+
+        unsigned validFrames(unsigned half) const { return valid[half]; } // less than halfFrames: the move ends in this half
+        bool done() const { return s >= sTgt && !fallPending && remaining == 0; }  // all frames generated
+
+        alignas(2 * halfFrames * sizeof(StepFrame)) StepFrame frames[2 * halfFrames]; // aligned to its size for DMA modulo addressing
+#if defined(TS4_HOST)
+        unsigned pinBase; // pin of bit 0 of the toggle masks
+#else
+        volatile uint32_t* toggleReg; // DR_TOGGLE of the GPIO port the masks refer to
+#endif
+
+     protected:
+        unsigned generate(StepFrame* f, unsigned n);
+        uint32_t nextStep(); // advances the profile by one step, returns the step pin bits
+
+        IntRamp ramp;
+        SlaveAxis slaves[TS4_MAX_GROUP_SIZE - 1];
+        unsigned nrSlaves = 0;
+        uint32_t leadMask;
+        volatile int32_t* leadPos;
+        int32_t leadDir, leadA;
+        int32_t s = 0, sTgt = 0, accEnd, decStart;
+
+        uint32_t pulse = 8 * (timerClock / 1'000'000); // 8µs, same as the timer based steppers
+        unsigned shift = 0;
+        uint32_t maxInterval = UINT32_MAX;
+        uint32_t rest;            // ticks lost by the shift, carried to the next frame
+
+        uint32_t toggle;          // bits of the frame being generated
+        uint32_t remaining = 0;   // backend ticks of the current pulse or pause still to be written
+        bool fallPending   = false;
+        uint32_t fallMask, fallTicks;
+
+        unsigned valid[2];
+    };
+
+    /**
+     * Implement this interface for hardware that outputs a StepStream (e.g. timer triggered DMA)
+     * start() primes the stream and starts the output, the backend calls stream.refill() whenever
+     * it finished one half of the buffer and stops by itself after the last frame.
+     **/
+    class IStreamBackend
+    {
+     public:
+        virtual bool start()           = 0; // false if the output is already running
+        virtual void stop()            = 0; // stops immediately
+        virtual bool isRunning() const = 0;
+
+        virtual ~IStreamBackend() {}
+
+        StepStream stream;
+    };
+}
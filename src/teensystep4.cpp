@@ -2,9 +2,20 @@
 #undef abs
 
 #include "teensystep4.h"
+#include "profiletick.h"
 #include "timers/timerfactory.h"
 #include "timers/interfaces.h"
+#if defined(TS4_HOST)
+#include "timers/Sim/SimTick.h"
+#include "timers/Sim/SimTimer.h"
+#else
+#include "timers/Teensy4/PIT/PitTick.h"
 #include "timers/Teensy4/TMR/TMR.h"
+#endif
+
+#if !defined(TS4_TMR_MODULES)
+#define TS4_TMR_MODULES 0b1000 // bit n: attach TMRn+1 to the timer factory (4 channels each), TMR4 only by default
+#endif
 
 
 namespace TS4
@@ -13,7 +24,17 @@ namespace TS4
     {
         if(useDefaultModule)
         {
-            TimerFactory::attachModule(new TMRModule<3>());
+#if defined(TS4_HOST)
+            TimerFactory::attachModule(new SimModule());
+            ProfileTick::attachTimer(new SimTick());
+#else
+            // TMR1..3 are opt-in, they drive analogWrite on pins 10-15, 18, 19 and the factory spreads the channels over all modules
+            if (TS4_TMR_MODULES & 0b1000) TimerFactory::attachModule(new TMRModule<3>());
+            if (TS4_TMR_MODULES & 0b0001) TimerFactory::attachModule(new TMRModule<0>());
+            if (TS4_TMR_MODULES & 0b0010) TimerFactory::attachModule(new TMRModule<1>());
+            if (TS4_TMR_MODULES & 0b0100) TimerFactory::attachModule(new TMRModule<2>());
+            ProfileTick::attachTimer(new PitTick());
+#endif
         }
     }
 }
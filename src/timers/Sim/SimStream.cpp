@@ -0,0 +1,47 @@
+#if defined(TS4_HOST)
+
+#include "SimStream.h"
+
+namespace TS4
+{
+    bool SimStream::start()
+    {
+        if (running) return false;
+
+        stream.prime();
+        frame   = 0;
+        running = true;
+        event(SimClock::now()); // first frame is output immediately
+        return true;
+    }
+
+    bool SimStream::nextEvent(uint64_t* time) const
+    {
+        *time = due;
+        return running;
+    }
+
+    void SimStream::event(uint64_t now)
+    {
+        constexpr unsigned half = StepStream::halfFrames;
+
+        unsigned h = frame / half;
+        unsigned i = frame % half;
+        if (i >= stream.validFrames(h)) // last frame done
+        {
+            running = false;
+            return;
+        }
+
+        const StepFrame& f = stream.frames[frame];
+        for (uint32_t bits = f.toggle; bits != 0; bits &= bits - 1)
+        {
+            digitalToggleFast(stream.pinBase + __builtin_ctz(bits));
+        }
+        due   = now + toNs(f.interval);
+        frame = (frame + 1) % (2 * half);
+
+        if (i == half - 1) stream.refill(h); // half complete interrupt of the DMA
+    }
+}
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "../../stepstream.h"
+#include "SimTimer.h"
+
+namespace TS4
+{
+    /**
+     * Simulated stream backend (host builds)
+     * Plays the frames of a StepStream on the virtual clock like the timer triggered DMA does on the
+     * Teensy: one frame per event, same tick quantization, and refills a half of the double buffer
+     * as soon as its last frame was read.
+     **/
+    class SimStream : public IStreamBackend, public SimDevice
+    {
+     public:
+        SimStream() { stream.setTiming(prescale, 0xFFFF); }
+
+        bool start() override;
+        void stop() override { running = false; }
+        bool isRunning() const override { return running; }
+
+     protected:
+        static constexpr int prescale = 5; // same as DmaStream
+
+        bool nextEvent(uint64_t* time) const override;
+        void event(uint64_t now) override;
+        void halt() override { running = false; }
+
+        bool running   = false;
+        unsigned frame = 0; // next frame to output
+        uint64_t due;       // ns
+
+        static uint64_t toNs(uint32_t ticks) { return ((uint64_t)ticks << prescale) * 1'000'000'000 / timerClock; }
+    };
+}
@@ -0,0 +1,30 @@
+#if defined(TS4_HOST)
+
+#include "SimTick.h"
+
+namespace TS4
+{
+    void SimTick::begin(uint32_t periodUs, isr_t tick, void* ctx)
+    {
+        callback = tick;
+        context  = ctx;
+        period   = periodUs * 1'000ull;
+        due      = SimClock::now() + period;
+        running  = true;
+    }
+
+    bool SimTick::nextEvent(uint64_t* time) const
+    {
+        if (running) *time = due;
+        return running;
+    }
+
+    void SimTick::event(uint64_t /*now*/)
+    {
+        due += period;
+        SimClock::isrDepth++;
+        callback(context);
+        SimClock::isrDepth--;
+    }
+}
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "SimTimer.h"
+
+namespace TS4
+{
+    /**
+     * Simulated profile tick (host builds)
+     * Calls the tick on the virtual clock every periodUs. There are no priorities on the host, a tick due
+     * at the same time as a step timer event runs in the order the devices were created.
+     **/
+    class SimTick : public ITickTimer, public SimDevice
+    {
+     public:
+        void begin(uint32_t periodUs, isr_t tick, void* ctx) override;
+        void end() override { running = false; }
+
+     protected:
+        bool nextEvent(uint64_t* time) const override;
+        void event(uint64_t now) override;
+        void halt() override { running = false; }
+
+        bool running = false;
+        uint64_t period, due; // ns
+        isr_t callback;
+        void* context;
+    };
+}
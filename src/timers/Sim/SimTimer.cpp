@@ -0,0 +1,249 @@
+#include "SimTimer.h"
+#include <algorithm>
+
+namespace TS4
+{
+    // SimTimer ===========================================================
+
+    void SimTimer::setPulseParams(float width_us, unsigned /*stpPin*/)
+    {
+        pulsewidth = std::max(1.0f, width_us * (timerClock / 1E6f) + 0.5f);
+    }
+
+    void SimTimer::start()
+    {
+        running       = true;
+        first         = true;
+        rest          = 0;
+        fracAcc       = 0;
+        postponeTicks = 0;
+        ISR();
+    }
+
+    void SimTimer::stop()
+    {
+        running = false;
+    }
+
+    void SimTimer::ISR()
+    {
+        uint64_t now = SimClock::now();
+        SimClock::isrDepth++;
+        if (first) // rising edge of the step pulse
+        {
+            nextEvent = now + toNs(pulsewidth);
+            first     = false;
+            stepIsr(context);
+            if (postponeTicks != 0) // no step, call stepIsr again later
+            {
+                nextEvent     = now + toNs(postponeTicks);
+                first         = true;
+                postponeTicks = 0;
+            }
+        }
+        else // falling edge, pause until next step
+        {
+            nextEvent = now + toNs(nextPause());
+            first     = true;
+            resetIsr(context);
+        }
+        SimClock::isrDepth--;
+    }
+
+    // SimDevice ==========================================================
+
+    SimDevice::SimDevice()
+    {
+        SimClock::devices.push_back(this);
+    }
+
+    SimDevice::~SimDevice()
+    {
+        auto& d = SimClock::devices;
+        d.erase(std::remove(d.begin(), d.end(), this), d.end());
+    }
+
+    // SimModule ==========================================================
+
+    SimModule::SimModule()
+    {
+        for (SimTimer& channel : channels) adopt(&channel);
+    }
+
+    ITimer* SimModule::getChannel()
+    {
+        if (freeMask == 0) return nullptr;
+
+        unsigned i = __builtin_ctz(freeMask);
+        freeMask &= ~(1u << i);
+        return &channels[i];
+    }
+
+    void SimModule::releaseChannel(ITimer* ch)
+    {
+        if (ch->getModule() != this) return;
+        freeMask |= 1u << (static_cast<SimTimer*>(ch) - channels);
+    }
+
+    void SimModule::ISR(uint64_t now)
+    {
+        TS4_PROFILE_ISR(isrStats);
+        for (int ch = 0; ch < 4; ch++)
+        {
+            if (!(freeMask & (1u << ch)) && channels[ch].running && channels[ch].nextEvent == now)
+            {
+                channels[ch].ISR();
+            }
+        }
+    }
+
+    bool SimModule::nextEvent(uint64_t* time) const
+    {
+        bool pending = false;
+        for (const SimTimer& ch : channels)
+        {
+            if (ch.running && (!pending || ch.nextEvent < *time))
+            {
+                pending = true;
+                *time   = ch.nextEvent;
+            }
+        }
+        return pending;
+    }
+
+    void SimModule::halt()
+    {
+        for (SimTimer& ch : channels) ch.stop();
+    }
+
+    // SimClock ===========================================================
+
+    uint64_t SimClock::t     = 0;
+    int SimClock::isrDepth   = 0;
+    std::vector<SimDevice*> SimClock::devices;
+
+    SimDevice* SimClock::nextDue(uint64_t limit, uint64_t* time)
+    {
+        SimDevice* due = nullptr;
+        for (SimDevice* d : devices)
+        {
+            uint64_t evt;
+            if (d->nextEvent(&evt) && evt <= limit && (due == nullptr || evt < *time))
+            {
+                due   = d;
+                *time = evt;
+            }
+        }
+        return due;
+    }
+
+    void SimClock::runUntil(uint64_t time)
+    {
+        uint64_t evt;
+        while (SimDevice* d = nextDue(time, &evt))
+        {
+            t = evt;
+            d->event(t);
+        }
+        t = std::max(t, time);
+    }
+
+    bool SimClock::runUntilIdle(uint64_t timeout)
+    {
+        uint64_t end = t + timeout;
+        uint64_t evt;
+        while (SimDevice* d = nextDue(end, &evt))
+        {
+            t = evt;
+            d->event(t);
+        }
+        return nextDue(UINT64_MAX, &evt) == nullptr;
+    }
+
+    void SimClock::reset()
+    {
+        t = 0;
+        for (SimDevice* d : devices) d->halt();
+    }
+
+    // SimTrace ===========================================================
+
+    SimTrace::PinTrace SimTrace::pins[maxPins];
+
+    void SimTrace::record(unsigned pin, bool level)
+    {
+        if (pin >= maxPins) return;
+        PinTrace& p = pins[pin];
+        if (level == p.level) return; // no edge
+
+        uint64_t now = SimClock::now();
+        if (p.count == 0)
+        {
+            p.firstEdge  = now;
+            p.firstLevel = level;
+        }
+        else
+        {
+            uint64_t delta = now - p.lastEdge;
+            if (delta < UINT32_MAX)
+            {
+                p.deltas.push_back(delta);
+            }
+            else
+            {
+                p.deltas.push_back(UINT32_MAX);
+                p.deltas.push_back(delta >> 32);
+                p.deltas.push_back((uint32_t)delta);
+            }
+        }
+        p.lastEdge = now;
+        p.level    = level;
+        p.count++;
+        if (level) p.rising++;
+    }
+
+    std::vector<uint64_t> SimTrace::PinTrace::edges(bool risingEdges) const
+    {
+        std::vector<uint64_t> result;
+        if (count == 0) return result;
+
+        uint64_t t = firstEdge;
+        bool lvl   = firstLevel;
+        if (lvl == risingEdges) result.push_back(t);
+        for (size_t i = 0; i < deltas.size(); i++)
+        {
+            uint64_t delta = deltas[i];
+            if (delta == UINT32_MAX)
+            {
+                delta = ((uint64_t)deltas[i + 1] << 32) | deltas[i + 2];
+                i += 2;
+            }
+            t += delta;
+            lvl = !lvl;
+            if (lvl == risingEdges) result.push_back(t);
+        }
+        return result;
+    }
+
+    const SimTrace::PinTrace& SimTrace::pin(unsigned pin)
+    {
+        return pins[pin < maxPins ? pin : 0];
+    }
+
+    size_t SimTrace::memoryUsage()
+    {
+        size_t bytes = 0;
+        for (const PinTrace& p : pins) bytes += p.deltas.capacity() * sizeof(uint32_t);
+        return bytes;
+    }
+
+    void SimTrace::clear()
+    {
+        for (PinTrace& p : pins)
+        {
+            bool level = p.level;
+            p          = PinTrace();
+            p.level    = level;
+        }
+    }
+}
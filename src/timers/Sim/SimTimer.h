@@ -0,0 +1,162 @@
+#pragma once
+
+#include "../interfaces.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace TS4
+{
+    /**
+     * Simulated timer channel
+     * Implements the ITimer interface against the virtual nanosecond clock of SimClock.
+     * Timing mirrors TmrTimer: periods are quantized to the auto ranged TMR tick and every
+     * step consists of a pulse phase (stepIsr) and a pause phase (resetIsr).
+     **/
+    class SimTimer : public ITimer
+    {
+     public:
+        void setPulseParams(float width, unsigned pin) override;
+        void start() override;
+        void stop() override;
+
+        bool isRunning() const { return running; }
+
+     protected:
+        uint32_t pulsewidth = 1600; // ticks of timerClock
+
+        uint32_t rest    = 0; // same carry of prescaler remainders and period fractions as TmrTimer
+        uint16_t fracAcc = 0;
+
+        // pause phase quantized like TmrTimer, the prescaler is selected per phase
+        uint32_t nextPause()
+        {
+            uint32_t frac = (uint32_t)fracAcc + periodFrac;
+            fracAcc       = frac;
+            uint32_t base = (period > pulsewidth ? period - pulsewidth : 1) + rest + (frac >> 16);
+            uint8_t p     = fitPrescale(base);
+            uint32_t t    = std::max(1u, base >> p) << p;
+            rest          = base > t ? base - t : 0;
+            return t;
+        }
+
+        bool running = false;
+        bool first   = true;
+        uint64_t nextEvent; // ns
+
+        void ISR();
+        static uint64_t toNs(uint32_t ticks) { return (uint64_t)ticks * 1'000'000'000 / timerClock; }
+
+        friend class SimModule;
+        friend class SimClock;
+    };
+
+    /**
+     * Anything producing events on the virtual clock (timer modules, simulated DMA, ...)
+     * Devices register with SimClock on construction.
+     **/
+    class SimDevice
+    {
+     public:
+        SimDevice();
+        virtual ~SimDevice();
+
+     protected:
+        virtual bool nextEvent(uint64_t* time) const = 0; // false if nothing is pending
+        virtual void event(uint64_t now)             = 0; // fire all events due at now
+        virtual void halt()                          = 0; // stop everything, called by SimClock::reset()
+
+        friend class SimClock;
+    };
+
+    /**
+     * Simulated timer module
+     * Four channels per module, like TMRModule. Channels of one module due at the same time
+     * are serviced in one module ISR in channel order.
+     **/
+    class SimModule : public ITimerModule, public SimDevice
+    {
+     public:
+        SimModule();
+
+        ITimer* getChannel() override;
+        void releaseChannel(ITimer* ch) override;
+        unsigned freeChannels() const override { return __builtin_popcount(freeMask); }
+
+#if defined(TS4_PROFILE)
+        const IsrStats* getIsrStats() const override { return &isrStats; } // host time, latency is always 0 on the virtual clock
+#endif
+
+     protected:
+        void ISR(uint64_t now);
+        bool nextEvent(uint64_t* time) const override;
+        void event(uint64_t now) override { ISR(now); }
+        void halt() override;
+#if defined(TS4_PROFILE)
+        IsrStats isrStats;
+#endif
+
+        SimTimer channels[4];
+        uint8_t freeMask = 0b1111; // bit n set: channel n is free
+
+        friend class SimClock;
+    };
+
+    /**
+     * Virtual clock driving all SimDevices
+     * Time only advances in run/runUntil, device events are fired in timestamp order.
+     **/
+    class SimClock
+    {
+     public:
+        static uint64_t now() { return t; } // ns
+        static bool inISR() { return isrDepth > 0; }
+
+        static void runUntil(uint64_t time);
+        static void run(uint64_t ns) { runUntil(t + ns); }
+        static bool runUntilIdle(uint64_t timeout = 60'000'000'000); // false if devices are still running after timeout
+        static void reset();
+
+     protected:
+        static uint64_t t;
+        static int isrDepth;
+        static std::vector<SimDevice*> devices;
+
+        static SimDevice* nextDue(uint64_t limit, uint64_t* time); // device with the earliest event <= limit
+
+        friend class SimDevice;
+        friend class SimTimer;
+        friend class SimTick;
+    };
+
+    /**
+     * Per pin record of all level changes on the digital pins (host builds only)
+     * Edges are stored as deltas (ns) to the previous edge of the same pin.
+     **/
+    class SimTrace
+    {
+     public:
+        struct PinTrace
+        {
+            uint64_t firstEdge = 0;      // ns
+            uint64_t lastEdge  = 0;      // ns
+            bool firstLevel    = false;  // level after the first edge, levels alternate from there
+            bool level         = false;
+            uint32_t count     = 0;      // number of recorded edges
+            uint32_t rising    = 0;      // number of rising edges (steps on a step pin)
+            std::vector<uint32_t> deltas; // deltas > 4.29s are stored as UINT32_MAX, high word, low word
+
+            std::vector<uint64_t> edges(bool risingEdges = true) const; // absolute times of rising (falling) edges
+        };
+
+        static void record(unsigned pin, bool level);
+        static const PinTrace& pin(unsigned pin);
+        static size_t memoryUsage();
+        static void clear();
+
+        static constexpr unsigned maxPins = 64;
+
+     protected:
+        static PinTrace pins[maxPins];
+    };
+}
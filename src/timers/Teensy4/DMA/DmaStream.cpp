@@ -0,0 +1,107 @@
+#if !defined(TS4_HOST)
+
+#include "DmaStream.h"
+
+namespace TS4
+{
+    constexpr unsigned bufferBytes = sizeof(StepStream::frames);
+    static_assert((bufferBytes & (bufferBytes - 1)) == 0, "TS4_STREAM_FRAMES must be a power of 2");
+
+    DmaStream* DmaStream::instance = nullptr;
+
+    DmaStream::DmaStream()
+    {
+        stream.setTiming(prescale, 0xFFFF);
+        instance = this;
+        CCM_CCGR6 |= CCM_CCGR6_QTIMER4(CCM_CCGR_ON);
+    }
+
+    bool DmaStream::start()
+    {
+        if (running) return false;
+        if (((uintptr_t)stream.frames & (bufferBytes - 1)) != 0) return false; // modulo addressing needs an aligned buffer
+
+        stream.prime();
+        const StepFrame* f      = stream.frames;
+        constexpr unsigned n    = 2 * StepStream::halfFrames;
+        constexpr unsigned smod = __builtin_ctz(bufferBytes);
+
+        // interval of frame k+2 -> CMPLD1 (frame k+1 is already loaded when frame k starts)
+        intervalDma.disable();
+        intervalDma.TCD->SADDR    = &f[2].interval;
+        intervalDma.TCD->SOFF     = sizeof(StepFrame);
+        intervalDma.TCD->ATTR     = DMA_TCD_ATTR_SSIZE(1) | DMA_TCD_ATTR_DSIZE(1) | DMA_TCD_ATTR_SMOD(smod);
+        intervalDma.TCD->NBYTES   = 2;
+        intervalDma.TCD->SLAST    = 0;
+        intervalDma.TCD->DADDR    = &regs->CMPLD1;
+        intervalDma.TCD->DOFF     = 0;
+        intervalDma.TCD->CITER    = n;
+        intervalDma.TCD->BITER    = n;
+        intervalDma.TCD->DLASTSGA = 0;
+        intervalDma.TCD->CSR      = 0;
+        intervalDma.triggerAtHardwareEvent(DMAMUX_SOURCE_QTIMER4_WRITE0_CMPLD1);
+
+        // toggle mask of frame k+1 -> DR_TOGGLE, linked to every interval transfer
+        toggleDma.disable();
+        toggleDma.TCD->SADDR    = &f[1].toggle;
+        toggleDma.TCD->SOFF     = sizeof(StepFrame);
+        toggleDma.TCD->ATTR     = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2) | DMA_TCD_ATTR_SMOD(smod);
+        toggleDma.TCD->NBYTES   = 4;
+        toggleDma.TCD->SLAST    = 0;
+        toggleDma.TCD->DADDR    = stream.toggleReg;
+        toggleDma.TCD->DOFF     = 0;
+        toggleDma.TCD->CITER    = n;
+        toggleDma.TCD->BITER    = n;
+        toggleDma.TCD->DLASTSGA = 0;
+        toggleDma.TCD->CSR      = 0;
+        toggleDma.triggerAtTransfersOf(intervalDma);
+        toggleDma.attachInterrupt(ISR);
+        toggleDma.interruptAtHalf();
+        toggleDma.interruptAtCompletion();
+
+        doneHalf = 0;
+        running  = true;
+        toggleDma.enable();
+        intervalDma.enable();
+
+        // counter runs from LOAD = 1 to COMP1, i.e. COMP1 ticks per frame
+        regs->CTRL   = 0;
+        regs->LOAD   = 1;
+        regs->CNTR   = 1;
+        regs->COMP1  = f[0].interval;
+        regs->CMPLD1 = f[1].interval;
+        regs->SCTRL  = 0;
+        regs->CSCTRL = TMR_CSCTRL_CL1(1); // load COMP1 from CMPLD1 on compare
+        regs->DMA    = TMR_DMA_CMPLD1DE;   // request the next interval when CMPLD1 was loaded
+
+        *stream.toggleReg = f[0].toggle;
+        regs->CTRL        = TMR_CTRL_CM(1) | TMR_CTRL_PCS(0b1000 | prescale) | TMR_CTRL_LENGTH;
+        return true;
+    }
+
+    void DmaStream::stop()
+    {
+        regs->CTRL = 0;
+        regs->DMA  = 0;
+        intervalDma.disable();
+        toggleDma.disable();
+        running = false;
+    }
+
+    void DmaStream::ISR()
+    {
+        DmaStream* self = instance;
+        self->toggleDma.clearInterrupt();
+
+        unsigned half = self->doneHalf;
+        self->doneHalf ^= 1;
+        if (self->stream.validFrames(half) < StepStream::halfFrames) // the move ended in this half
+        {
+            self->stop();
+            return;
+        }
+        self->stream.refill(half);
+        asm volatile("dsb");
+    }
+}
+#endif
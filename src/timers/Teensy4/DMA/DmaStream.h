@@ -0,0 +1,42 @@
+#pragma once
+
+#include "../../../stepstream.h"
+#include "Arduino.h"
+#include "DMAChannel.h"
+#include "imxrt.h"
+
+namespace TS4
+{
+    /**
+     * Teensy 4.x stream backend: QuadTimer triggered DMA
+     * Channel 0 of TMR4 counts the frame intervals. Each compare event loads the next interval from
+     * CMPLD1 and requests a DMA transfer which writes the interval after it into CMPLD1, a linked
+     * channel writes the toggle mask of the frame to DR_TOGGLE of the step pin port. Both channels
+     * read the double buffer of the stream with modulo addressing, the CPU is only interrupted when
+     * one half of the buffer is done.
+     * Use a single, statically allocated instance (the frame buffer needs its natural alignment and
+     * the DMA interrupt is static).
+     **/
+    class DmaStream : public IStreamBackend
+    {
+     public:
+        DmaStream();
+        ~DmaStream() { stop(); }
+
+        bool start() override;
+        void stop() override;
+        bool isRunning() const override { return running; }
+
+     protected:
+        static constexpr int prescale = 5; // 16 bit intervals at /32 cover 14ms per frame
+
+        IMXRT_TMR_CH_t* const regs = &IMXRT_TMR4.CH[0];
+        DMAChannel intervalDma, toggleDma;
+
+        volatile bool running = false;
+        unsigned doneHalf     = 0; // half completed at the next DMA interrupt
+
+        static DmaStream* instance;
+        static void ISR();
+    };
+}
@@ -0,0 +1,19 @@
+#if !defined(TS4_HOST)
+
+#include "PitTick.h"
+
+namespace TS4
+{
+    isr_t PitTick::callback;
+    void* PitTick::context;
+
+    void PitTick::begin(uint32_t periodUs, isr_t tick, void* ctx)
+    {
+        callback = tick;
+        context  = ctx;
+        timer.priority(TS4_TICK_PRIORITY);
+        timer.begin(ISR, periodUs);
+    }
+}
+
+#endif
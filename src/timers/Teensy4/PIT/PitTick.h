@@ -0,0 +1,29 @@
+#pragma once
+
+#include "../../interfaces.h"
+#include "IntervalTimer.h"
+
+#if !defined(TS4_TICK_PRIORITY)
+#define TS4_TICK_PRIORITY 192 // NVIC priority of the profile tick, below the TMR step interrupts (128)
+#endif
+
+namespace TS4
+{
+    /**
+     * Profile tick on a PIT channel (IntervalTimer of the Teensy core)
+     * The channel is only allocated while the tick is running.
+     **/
+    class PitTick : public ITickTimer
+    {
+     public:
+        void begin(uint32_t periodUs, isr_t tick, void* ctx) override;
+        void end() override { timer.end(); }
+
+     protected:
+        IntervalTimer timer;
+
+        static void ISR() { callback(context); } // IntervalTimer takes a plain function
+        static isr_t callback;
+        static void* context;
+    };
+}
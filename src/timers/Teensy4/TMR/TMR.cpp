@@ -1,3 +1,5 @@
+#if !defined(TS4_HOST)
+
 #include "TMR.h"
 
 //#if defined (ARDUINO_TEENSY_MICROMOD)
@@ -35,4 +37,6 @@ namespace TS4
    
 }
 
-//#endif
\ No newline at end of file
+//#endif
+
+#endif
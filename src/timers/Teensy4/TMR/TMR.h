@@ -3,6 +3,7 @@
 #include "../../interfaces.h"
 #include "Arduino.h"
 #include "imxrt.h"
+#include <algorithm>
 
 namespace TS4
 {
@@ -10,33 +11,58 @@ namespace TS4
      * Teensy 4.x TMR timer
      * Implements the ITimer interface and models
      * one of the four channels of a TMR module
+     *
+     * Default: two interrupts per step, stepIsr sets the step pin, resetIsr clears it after the pulse width.
+     * Hardware pulse (usePinOutput): the channel output OFLAG is muxed to the step pin and toggled by the
+     * timer with alternating compare registers (COMP1: pulse, COMP2: pause). The only interrupt per step
+     * runs at the falling edge, loads the pause which just started and calls stepIsr for the next step.
+     * If stepIsr ends the move the timer stops before the next rising edge. Available on pins 10, 11, 12 (TMR1),
+     * 13 (TMR2) and 14, 15, 18, 19 (TMR3) if the corresponding TMRModule is attached to the TimerFactory.
+     *
+     * The prescaler is selected per phase for the best resolution (period < 437µs: 6.7ns ticks).
+     * Pauses longer than a 16 bit cycle at /128 (56ms) run additional full counter cycles without
+     * callbacks. In the hardware pulse mode OFLAG only clears on compare during such a pause, the rising edge
+     * is forced when it is over. Ticks dropped by the prescaler and the fractional part of the period are
+     * carried over to the next pause, the average period is exact.
      **/
     class TmrTimer : public ITimer
     {
      public:
-        inline TmrTimer(IMXRT_TMR_CH_t* const regs);
+        inline TmrTimer(IMXRT_TMR_CH_t* const regs, int8_t outPin = -1);
         ~TmrTimer() { stop(); }
 
         inline void setPulseParams(float width, unsigned pin);
+        inline bool usePinOutput(unsigned pin) override;
 
-        inline void updateFrequency(float f) override;
         inline void start() override;
         inline void stop() override;
 
-        inline void attachCallbacks(callback_t stepCb, callback_t resetCb) override;
-
      protected:
-        static constexpr int prescale = 5; // 1->2, 2->4, 3->8...7->128
-
-        callback_t stepCB;
-        callback_t resetCB;
         uint8_t stpPin;
-        uint16_t pulsewidth;
-        uint16_t period;
+        uint32_t pulsewidth;  // ticks of timerClock
+        uint8_t prescale = 0; // counter clock is timerClock >> prescale, 1->2, 2->4, 3->8...7->128
+        uint16_t laps    = 0; // full counter cycles still to run in the current pause
+        uint32_t rest    = 0; // timerClock ticks dropped by the prescaler, carried to the next pause
+        uint16_t fracAcc = 0; // accumulated period fractions, adds a tick on overflow
+
+        uint32_t pauseTicks() const { return period > pulsewidth ? period - pulsewidth : 1; } // ticks of timerClock
+        uint16_t pulseCompare() const { return pulsewidth >> prescale > 1 ? (pulsewidth >> prescale) - 1 : 0; }
+
+        inline void setPrescale(uint8_t p); // changes the counter clock, keeps the time elapsed since the last compare
+        inline uint16_t loadPause();        // prescaler and laps for the pause phase, returns its compare value
+        inline void loadPostponed();        // prescaler and compare value of a postponed step
+        inline void startPulses();          // hardware pulse mode: first step, then OFLAG raises the pin
+        inline void resumePulses();         // hardware pulse mode: rising edge after a long pause
 
         IMXRT_TMR_CH_t* const regs;
         inline void ISR();
 
+        const int8_t outPin;     // pin connected to OFLAG of this channel, -1 if none
+        bool hwPulse = false;    // OFLAG generates the step pulses
+        bool leadIn  = false;    // first step postponed, OFLAG is held low until the compare event
+        bool gap     = false;    // hardware pulse mode: pause longer than a counter cycle, OFLAG is held low
+        uint32_t gpioMux;        // pin mux to restore when the move is done
+
         template <unsigned>
         friend class TMRModule;
 
@@ -45,11 +71,11 @@ namespace TS4
 
     // inline implementation ===========================================================
 
-    TmrTimer::TmrTimer(IMXRT_TMR_CH_t* const _regs)
-        : regs(_regs)
+    TmrTimer::TmrTimer(IMXRT_TMR_CH_t* const _regs, int8_t _outPin)
+        : regs(_regs), outPin(_outPin)
     {
-        period     = 1000;
-        pulsewidth = 50;
+        pulsewidth = 1600;
+        prescale   = 5;
 
         regs->CTRL   = 0x0000;
         regs->CNTR   = 0x0000;
@@ -69,11 +95,19 @@ namespace TS4
 
     void TmrTimer::start()
     {
+        prescale      = fitPrescale(pulsewidth);
+        laps          = 0;
+        rest          = 0;
+        fracAcc       = 0;
+        leadIn        = false;
+        gap           = false;
+        postponeTicks = 0;
+
         regs->CTRL   = 0x0000;
         regs->CNTR   = 0x0000;
         regs->LOAD   = 0x0000;
-        regs->COMP1  = pulsewidth;
-        regs->CMPLD1 = pulsewidth;
+        regs->COMP1  = pulseCompare();
+        regs->CMPLD1 = pulseCompare();
 
         regs->CSCTRL &= ~TMR_CSCTRL_TCF1EN;
         regs->CSCTRL &= ~TMR_CSCTRL_TCF2EN;
@@ -81,12 +115,63 @@ namespace TS4
         regs->CSCTRL &= ~TMR_CSCTRL_TCF2;
         regs->CSCTRL = 0;
         regs->SCTRL  = 0;
+
+        if (hwPulse)
+        {
+            gpioMux = *portConfigRegister(outPin);
+            startPulses();
+            return;
+        }
+
         regs->CTRL   = TMR_CTRL_CM(1) | TMR_CTRL_PCS(0b1000 | prescale) | TMR_CTRL_LENGTH;
         regs->CSCTRL |= TMR_CSCTRL_TCF1EN;
         first = true;
         ISR();
     }
 
+    void TmrTimer::startPulses()
+    {
+        stepIsr(context); // first step, sets the period
+        if (!hwPulse) return; // move was already done
+
+        if (postponeTicks != 0) // OFLAG stays low, startPulses() is called again from the ISR
+        {
+            leadIn = true;
+            loadPostponed();
+            regs->CSCTRL = TMR_CSCTRL_TCF1EN;
+            regs->SCTRL  = TMR_SCTRL_OEN | TMR_SCTRL_FORCE;
+            *portConfigRegister(outPin) = 1; // ALT1: QTIMERx_TIMERy
+            regs->CTRL = TMR_CTRL_CM(1) | TMR_CTRL_PCS(0b1000 | prescale) | TMR_CTRL_LENGTH | TMR_CTRL_OUTMODE(0b001); // clear OFLAG on compare
+            return;
+        }
+
+        regs->COMP2  = loadPause(); // pulse and pause share the prescaler, the ISR at the falling edge reloads the pause
+        laps         = 0;
+        regs->COMP1  = pulseCompare();
+        regs->CSCTRL = TMR_CSCTRL_TCF1EN;
+        regs->SCTRL  = TMR_SCTRL_OEN | TMR_SCTRL_VAL | TMR_SCTRL_FORCE; // rising edge of the first pulse
+        *portConfigRegister(outPin) = 1; // ALT1: QTIMERx_TIMERy
+        regs->CTRL = TMR_CTRL_CM(1) | TMR_CTRL_PCS(0b1000 | prescale) | TMR_CTRL_LENGTH | TMR_CTRL_OUTMODE(0b100); // toggle OFLAG on alternating compares
+    }
+
+    void TmrTimer::resumePulses()
+    {
+        regs->CTRL   = 0;
+        regs->COMP1  = pulseCompare(); // same prescaler as the pause, see loadPause
+        regs->COMP2  = 0xFFFF;         // set at the falling edge
+        regs->SCTRL  = TMR_SCTRL_OEN | TMR_SCTRL_VAL | TMR_SCTRL_FORCE;
+        regs->CTRL   = TMR_CTRL_CM(1) | TMR_CTRL_PCS(0b1000 | prescale) | TMR_CTRL_LENGTH | TMR_CTRL_OUTMODE(0b100);
+    }
+
+    void TmrTimer::loadPostponed()
+    {
+        setPrescale(fitPrescale(postponeTicks));
+        uint16_t c    = std::max(1u, postponeTicks >> prescale) - 1;
+        regs->COMP1   = c;
+        regs->CMPLD1  = c;
+        postponeTicks = 0;
+    }
+
     void TmrTimer::stop()
     {
         // regs->SCTRL &= ~TMR_SCTRL_TCF;
@@ -95,36 +180,107 @@ namespace TS4
 
         regs->CTRL = 0;
 
+        if (hwPulse) // hand the pin back to the GPIO, stepIsr left its output register set
+        {
+            hwPulse = false;
+            if (regs->SCTRL & TMR_SCTRL_OEN)
+            {
+                regs->SCTRL = 0;
+                digitalWriteFast(outPin, LOW);
+                *portConfigRegister(outPin) = gpioMux;
+            }
+        }
+
         // regs->CSCTRL &= ~TMR_CSCTRL_TCF1EN;
         // regs->CSCTRL |= TMR_CSCTRL_TCF1;
     }
 
-    void TmrTimer::updateFrequency(float f)
+    void TmrTimer::setPulseParams(float width_us, unsigned stpPin)
     {
-        constexpr unsigned prescale = 32;
-        period                      = (150E6 / prescale) / f - pulsewidth - 1.5f;
-        //Serial.printf("p: %d\n", period);
+        this->pulsewidth = std::max(1.0f, width_us * (timerClock / 1E6f) + 0.5f);
+        this->stpPin     = stpPin;
 
-        //constexpr uint16_t pp = p;
+        //Serial.printf("setPulseParams %d\n", pulsewidth);
     }
 
-    void TmrTimer::attachCallbacks(callback_t stepCB, callback_t resetCB)
+    bool TmrTimer::usePinOutput(unsigned pin)
     {
-        this->stepCB  = stepCB;
-        this->resetCB = resetCB;
+        hwPulse = outPin >= 0 && pin == (unsigned)outPin;
+        return hwPulse;
     }
 
-    void TmrTimer::setPulseParams(float width_us, unsigned stpPin)
+    void TmrTimer::setPrescale(uint8_t p)
     {
-        constexpr unsigned prescale = 32;
-        this->pulsewidth            = width_us * (150.0f / prescale) + 0.5;
-        this->stpPin                = stpPin;
+        if (p == prescale) return;
+        regs->CTRL = (regs->CTRL & ~TMR_CTRL_PCS(0b1111)) | TMR_CTRL_PCS(0b1000 | p);
+        regs->CNTR = ((uint32_t)regs->CNTR << prescale) >> p;
+        prescale   = p;
+    }
 
-        //Serial.printf("setPulseParams %d\n", pulsewidth);
+    uint16_t TmrTimer::loadPause()
+    {
+        uint32_t frac = (uint32_t)fracAcc + periodFrac;
+        fracAcc       = frac;
+        uint32_t base = pauseTicks() + rest + (frac >> 16);
+
+        uint8_t p      = fitPrescale(base);
+        uint32_t ticks = std::max(1u, base >> p);
+        if (hwPulse) base += pulsewidth & ((1u << p) - 1); // the pulse of the next step is truncated to the same prescaler
+        rest = base > ticks << p ? base - (ticks << p) : 0;
+        if (ticks > 0x10000) // longer than a counter cycle at the largest prescaler
+        {
+            laps  = (ticks - 1) >> 16;
+            ticks = ticks - (laps << 16);
+        }
+        setPrescale(p);
+        return ticks - 1; // the counter runs COMP1 + 1 ticks per phase
     }
 
     void TmrTimer::ISR()
     {
+        if (laps > 0) // long pause, one more full counter cycle
+        {
+            laps--;
+            regs->COMP1  = 0xFFFF;
+            regs->CMPLD1 = 0xFFFF;
+            return;
+        }
+
+        if (leadIn) // postponed first step of the hardware pulse mode is due
+        {
+            leadIn     = false;
+            regs->CTRL = 0;
+            prescale   = fitPrescale(pulsewidth);
+            startPulses();
+            return;
+        }
+
+        if (gap) // long pause of the hardware pulse mode is over
+        {
+            gap = false;
+            resumePulses();
+            return;
+        }
+
+        if (hwPulse) // falling edge of the pulse, the timer raises the pin again when the pause is over
+        {
+            uint16_t p = loadPause(); // pause of the current step
+            if (laps > 0) // OFLAG must not toggle on the compares of the additional counter cycles
+            {
+                gap          = true;
+                regs->COMP1  = p;
+                regs->CMPLD1 = p;
+                regs->CTRL   = TMR_CTRL_CM(1) | TMR_CTRL_PCS(0b1000 | prescale) | TMR_CTRL_LENGTH | TMR_CTRL_OUTMODE(0b001); // clear OFLAG on compare
+            }
+            else
+            {
+                regs->COMP2 = p;
+                regs->COMP1 = pulseCompare();
+            }
+            stepIsr(context); // next step, sets the period used at the next falling edge
+            return;
+        }
+
         //Serial.printf("isr %p\n", regs);
 
         // if (regs->CSCTRL & TMR_CSCTRL_TCF1)
@@ -132,17 +288,24 @@ namespace TS4
         //     regs->CSCTRL &= ~TMR_CSCTRL_TCF1; // clear interrupt flag
         if (first)                     // generate rising edge of pulse
         {                              //
-            regs->COMP1  = pulsewidth; // set reload to pulse width
-            regs->CMPLD1 = pulsewidth;
+            setPrescale(fitPrescale(pulsewidth));
+            regs->COMP1  = pulseCompare(); // set reload to pulse width
+            regs->CMPLD1 = pulseCompare();
             first        = false;  // generate falling pulse edge when called next
-            stepCB();              //
+            stepIsr(context);      //
+            if (postponeTicks != 0) // no step, call stepIsr again later
+            {
+                loadPostponed();
+                first = true;
+            }
         }                          //
         else                       //
         {                          //
-            regs->COMP1  = period; // set reload, period is already reduced by the pulsewidth time
-            regs->CMPLD1 = period; //
-            resetCB();             // reset the step pin
-            first = true;          // generate rising edge when called next
+            uint16_t p   = loadPause(); // period minus the pulsewidth time
+            regs->COMP1  = p;           // set reload
+            regs->CMPLD1 = p;            //
+            resetIsr(context);           // reset the step pin
+            first = true;                // generate rising edge when called next
         }
         //}
     }
@@ -156,6 +319,7 @@ namespace TS4
      *
      * getChannel() returns a pointer to a free timer channel.
      * returnChannel(IStepTimer*) releases the passed in timer.
+     * Free channels are kept as a bit mask, allocation and release are O(1).
      **/
 
     template <unsigned moduleNr>
@@ -166,16 +330,27 @@ namespace TS4
         ~TMRModule();
 
         ITimer* getChannel();
+        ITimer* getPinChannel(unsigned pin) override;
         void releaseChannel(ITimer* ch);
+        unsigned freeChannels() const override { return __builtin_popcount(freeMask); }
+
+#if defined(TS4_PROFILE)
+        const IsrStats* getIsrStats() const override { return &isrStats; }
+#endif
 
      protected:
-        static void ISR();
+        static void ISR();                              // services the channels with a pending compare flag
+        static inline void serviceChannel(unsigned ch); // compare flag already cleared
+#if defined(TS4_PROFILE)
+        static IsrStats isrStats;
+#endif
 
         static TmrTimer* channels[4];
+        static int8_t outputPin(unsigned ch); // pin connected to OFLAG of a channel (Teensy 4.0/4.1), -1 if none
 
         static_assert(moduleNr < 4, "Wrong TMR module number");
         static constexpr uintptr_t tmrAddresses[]{IMXRT_TMR1_ADDRESS, IMXRT_TMR2_ADDRESS, IMXRT_TMR3_ADDRESS, IMXRT_TMR4_ADDRESS};
-        static bool isFree[4];
+        static uint8_t freeMask; // bit n set: channel n is free
         static constexpr IRQ_NUMBER_t tmrIRQs[]{IRQ_QTIMER1, IRQ_QTIMER2, IRQ_QTIMER3, IRQ_QTIMER4};
         static IMXRT_TMR_t* const regs;
     };
@@ -186,6 +361,8 @@ namespace TS4
     {
         //Serial.printf("TMRModule cstr %p %d\n", this, moduleNr);
 
+        for (TmrTimer* channel : channels) adopt(channel);
+
         attachInterruptVector(tmrIRQs[moduleNr], ISR);
         NVIC_ENABLE_IRQ(tmrIRQs[moduleNr]);
     };
@@ -205,66 +382,96 @@ namespace TS4
     template <unsigned moduleNr>
     ITimer* TMRModule<moduleNr>::getChannel()
     {
-        //Serial.println("TMRModule::getTimer");
-        //Serial.flush();
+        if (freeMask == 0) return nullptr;
 
-        //  isFree[0] = false;
-        //  return (ITimer*)channels[0];
+        unsigned i = __builtin_ctz(freeMask);
+        freeMask &= ~(1u << i);
+        return channels[i];
+    }
 
-        for (int i = 0; i < 4; i++)
+    //---------------------------------------------------------------------------
+    template <unsigned moduleNr>
+    ITimer* TMRModule<moduleNr>::getPinChannel(unsigned pin)
+    {
+        for (unsigned i = 0; i < 4; i++)
         {
-            if (isFree[i])
+            if ((freeMask & (1u << i)) && outputPin(i) == (int)pin)
             {
-                isFree[i] = false;
-                return (ITimer*)channels[i];
+                freeMask &= ~(1u << i);
+                return channels[i];
             }
         }
-
         return nullptr;
     }
 
+    template <unsigned moduleNr>
+    int8_t TMRModule<moduleNr>::outputPin(unsigned ch)
+    {
+        static const int8_t pins[4][4]{{10, 12, 11, -1}, {13, -1, -1, -1}, {19, 18, 14, 15}, {-1, -1, -1, -1}};
+        return pins[moduleNr][ch];
+    }
+
     //---------------------------------------------------------------------------
     template <unsigned moduleNr>
     void TMRModule<moduleNr>::releaseChannel(ITimer* ch)
     {
-        for (int i = 0; i < 4; i++)
-        {
-            if (ch == channels[i])
-            {
-                isFree[i] = true;
-            }
-        }
+        if (ch->getModule() != this) return;
+
+        unsigned i = static_cast<TmrTimer*>(ch)->regs - regs->CH; // channel number from its register block
+        freeMask |= 1u << i;
     }
 
     //---------------------------------------------------------------------------
     template <unsigned moduleNr>
     void TMRModule<moduleNr>::ISR()
     {
-        for (int ch = 0; ch < 4; ch++)
+        TS4_PROFILE_ISR(isrStats);
+
+        // collect and clear the pending compare flags of the channels in use, one read and one write per channel
+        uint32_t pending = 0;
+        for (uint32_t busy = ~freeMask & 0x0F; busy != 0; busy &= busy - 1)
         {
-            if (!isFree[ch] && (channels[ch]->regs->CSCTRL & TMR_CSCTRL_TCF1))
+            unsigned ch     = __builtin_ctz(busy);
+            uint16_t csctrl = channels[ch]->regs->CSCTRL;
+            if (csctrl & TMR_CSCTRL_TCF1)
             {
-                channels[ch]->regs->CSCTRL &= ~TMR_CSCTRL_TCF1;
-                channels[ch]->ISR();
+                channels[ch]->regs->CSCTRL = csctrl & ~TMR_CSCTRL_TCF1;
+                pending |= 1u << ch;
             }
         }
+
+        for (; pending != 0; pending &= pending - 1) serviceChannel(__builtin_ctz(pending));
+
         asm volatile("dsb"); //wait until register changes propagated through the cache
     }
 
+    template <unsigned moduleNr>
+    void TMRModule<moduleNr>::serviceChannel(unsigned ch)
+    {
+        // counter restarted at the compare event, its value is the latency in timer ticks
+        TS4_PROFILE_LATENCY(isrStats, ((uint64_t)channels[ch]->regs->CNTR << channels[ch]->prescale) * profileCounterFrequency() / timerClock);
+        channels[ch]->ISR();
+    }
+
     // initialize static members ---------------------------------------------------------------------------------------------
 
     template <unsigned modNr>
     IMXRT_TMR_t* const TMRModule<modNr>::regs = ((IMXRT_TMR_t*)(tmrAddresses[modNr])); // pointer to the TMRn register block
 
+#if defined(TS4_PROFILE)
+    template <unsigned modNr>
+    IsrStats TMRModule<modNr>::isrStats;
+#endif
+
     template <unsigned modNr>
-    bool TMRModule<modNr>::isFree[4]{true, true, true, true}; // housekeeping of free channels
+    uint8_t TMRModule<modNr>::freeMask = 0b1111; // housekeeping of free channels
 
     template <unsigned modNr>
     TmrTimer* TMRModule<modNr>::channels[4]{
-        new TmrTimer(&regs->CH[0]),
-        new TmrTimer(&regs->CH[1]),
-        new TmrTimer(&regs->CH[2]),
-        new TmrTimer(&regs->CH[3]),
+        new TmrTimer(&regs->CH[0], outputPin(0)),
+        new TmrTimer(&regs->CH[1], outputPin(1)),
+        new TmrTimer(&regs->CH[2], outputPin(2)),
+        new TmrTimer(&regs->CH[3], outputPin(3)),
     };
 
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "Arduino.h"
+#include "../profiler.h"
 #include <functional>
 #include <vector>
 
@@ -10,23 +11,108 @@ namespace TS4
         return (0 < v) - (v < 0);
     }
 
+    // step periods passed to ITimer::updatePeriod are counted in ticks of this clock (Hz)
+    constexpr uint32_t timerClock = 150'000'000;
+
+    // smallest power of two prescaler (0..7) fitting a phase of 'ticks' into one 16 bit counter cycle
+    inline uint8_t fitPrescale(uint32_t ticks)
+    {
+        if (ticks <= 0x10000) return 0;
+        unsigned p = 16 - __builtin_clz(ticks - 1);
+        return p < 7 ? p : 7;
+    }
+
     using callback_t = std::function<void(void)>;
+    using isr_t      = void (*)(void* context);
+
+    class ITimerModule;
 
     // Implement this interface for the timers you want to use
+    // The timer ISR calls stepIsr(context) and resetIsr(context) and loads 'period' for the next step.
     class ITimer
     {
      public:
-        virtual void setPulseParams(float width, unsigned pin)              = 0;
-        virtual void attachCallbacks(callback_t stepCb, callback_t resetCb) = 0;
-        virtual void updateFrequency(float f)                               = 0;
-        virtual void start()                                                = 0;
-        virtual void stop()                                                 = 0;
+        virtual void setPulseParams(float width, unsigned pin) = 0;
+        virtual void start()                                   = 0;
+        virtual void stop()                                    = 0;
+
+        // true if the timer generates the step pulses on pin itself from the next start() on,
+        // only stepIsr is called then (once per step). Cleared by stop()
+        virtual bool usePinOutput(unsigned /*pin*/) { return false; }
+
+        // statically dispatched callbacks (function pointer + context), no heap and no type erasure per step
+        void attachIsr(isr_t step, isr_t reset, void* ctx)
+        {
+            stepIsr  = step;
+            resetIsr = reset;
+            context  = ctx;
+        }
+
+        // period of the next step in ticks of timerClock, non virtual, can be called on each step
+        // frac: additional fraction of a tick (1/65536), timers accumulate it so that the average period is exact
+        void updatePeriod(uint32_t ticks, uint16_t frac = 0)
+        {
+            period     = ticks;
+            periodFrac = frac;
+        }
+
+        // stretches the period set by updatePeriod by f, e.g. arc interpolation: path length of the next lead step
+        void scalePeriod(float f)
+        {
+            float p    = (period + periodFrac * (1.0f / 65536)) * f;
+            period     = p;
+            periodFrac = (p - period) * 65536;
+        }
+
+        uint32_t getPeriod() const { return period; } // period of the next step as set by the step ISR
+        uint16_t getPeriodFrac() const { return periodFrac; }
+
+        // called from stepIsr instead of stepping: the timer calls stepIsr again after 'ticks' without a pulse in
+        // between (e.g. direction setup time). Pin output timers only support it for the first step after start()
+        void postpone(uint32_t ticks) { postponeTicks = ticks; }
+
+        // period of the next step from a speed in steps/s, keeps the remainder of the division as fraction
+        void updateSpeed(uint32_t v)
+        {
+            period     = timerClock / v;
+            periodFrac = (float)(timerClock - period * v) * 65536.0f / v;
+        }
+
+        virtual void attachCallbacks(callback_t stepCb, callback_t resetCb);
+        virtual void updateFrequency(float f)
+        {
+            double p   = (double)timerClock / f;
+            period     = p;
+            periodFrac = (p - period) * 65536;
+        }
+
+        ITimerModule* getModule() const { return module; } // module owning the channel
 
         virtual ~ITimer() {}
 
      protected:
+        ITimerModule* module   = nullptr; // set by ITimerModule::adopt
+        isr_t stepIsr          = nullptr;
+        isr_t resetIsr         = nullptr;
+        void* context          = nullptr;
+        uint32_t period        = timerClock / 1000;
+        uint16_t periodFrac    = 0;
+        uint32_t postponeTicks = 0; // set by postpone() during stepIsr
+
+        callback_t stepCB, resetCB; // only used by attachCallbacks
+        static void callStepCB(void* timer) { static_cast<ITimer*>(timer)->stepCB(); }
+        static void callResetCB(void* timer) { static_cast<ITimer*>(timer)->resetCB(); }
+
+        friend class ITimerModule;
     };
 
+    inline void ITimer::attachCallbacks(callback_t stepCb, callback_t resetCb)
+    {
+        stepCB  = stepCb;
+        resetCB = resetCb;
+        attachIsr(callStepCB, callResetCB, this);
+    }
+
     //==============================================================
     // A TimerModule has one or more timer channels.
     //
@@ -36,5 +122,28 @@ namespace TS4
      public:
         virtual ITimer* getChannel()         = 0;
         virtual void releaseChannel(ITimer*) = 0;
+
+        virtual ITimer* getPinChannel(unsigned /*pin*/) { return nullptr; } // free channel able to drive pin, nullptr if none
+        virtual unsigned freeChannels() const { return 1; }                 // used by the factory to spread channels over the modules
+
+#if defined(TS4_PROFILE)
+        virtual const IsrStats* getIsrStats() const { return nullptr; }
+#endif
+
+     protected:
+        void adopt(ITimer* channel) { channel->module = this; } // call for all channels, TimerFactory::returnTimer relies on it
+    };
+
+    //==============================================================
+    // Periodic interrupt below the priority of the step timers, runs the fixed rate profile (see profiletick.h)
+    //
+
+    class ITickTimer
+    {
+     public:
+        virtual void begin(uint32_t periodUs, isr_t tick, void* ctx) = 0;
+        virtual void end()                                         = 0;
+
+        virtual ~ITickTimer() {}
     };
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "timerfactory.h"
+#include <algorithm>
 #include <vector>
 
 namespace TS4
@@ -15,19 +16,68 @@ namespace TS4
             modules.push_back(module);
         }
 
+        void detachModule(ITimerModule* module)
+        {
+            modules.erase(std::remove(modules.begin(), modules.end(), module), modules.end());
+        }
+
         ITimer* makeTimer()
         {
+            // take the channel from the module with the most free channels, each module has its own
+            // IRQ so that spreading the channels keeps the per ISR work low
+            ITimerModule* best = nullptr;
+            unsigned bestFree  = 0;
             for (ITimerModule* m : modules)
             {
-                ITimer* timer = m->getChannel();
+                unsigned free = m->freeChannels();
+                if (free > bestFree)
+                {
+                    best     = m;
+                    bestFree = free;
+                }
+            }
+
+            ITimer* timer = best != nullptr ? best->getChannel() : nullptr;
+            if (timer != nullptr) return timer;
+
+            for (ITimerModule* m : modules) // modules not reporting their free channels
+            {
+                timer = m->getChannel();
                 if (timer != nullptr) return timer;
             }
             return nullptr;
         }
 
+        ITimer* makeTimer(unsigned stepPin)
+        {
+            for (ITimerModule* m : modules)
+            {
+                ITimer* timer = m->getPinChannel(stepPin);
+                if (timer != nullptr) return timer;
+            }
+            return makeTimer();
+        }
+
         void returnTimer(ITimer* timer)
         {
-            modules[0]->releaseChannel(timer);  /// FIX
+            if (timer == nullptr) return;
+
+            if (timer->getModule() != nullptr)
+                timer->getModule()->releaseChannel(timer);
+            else
+                for (ITimerModule* m : modules) m->releaseChannel(timer); // channels of modules which don't adopt them
+        }
+
+#if defined(TS4_PROFILE)
+        unsigned moduleCount()
+        {
+            return modules.size();
+        }
+
+        const IsrStats* getModuleStats(unsigned module)
+        {
+            return module < modules.size() ? modules[module]->getIsrStats() : nullptr;
         }
+#endif
     }
 }
\ No newline at end of file
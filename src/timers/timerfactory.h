@@ -7,7 +7,14 @@ namespace TS4
     namespace TimerFactory
     {
         extern void attachModule(ITimerModule*);
+        extern void detachModule(ITimerModule*); // all its channels must have been returned
         extern ITimer* makeTimer();
+        extern ITimer* makeTimer(unsigned stepPin); // prefers a channel which can generate the pulses on stepPin
         extern void returnTimer(  ITimer* timer);
+
+#if defined(TS4_PROFILE)
+        extern unsigned moduleCount();
+        extern const IsrStats* getModuleStats(unsigned module); // nullptr if the module doesn't record statistics
+#endif
     }
 }
\ No newline at end of file
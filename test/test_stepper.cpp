@@ -1,6 +1,28 @@
 #include <unity.h>
 
 #include "teensystep4.h"
+#if defined(TS4_HOST)
+#include "gcode.h"
+#include "timers/Sim/SimStream.h"
+#include "timers/Sim/SimTimer.h"
+#include "timers/timerfactory.h"
+#include "timers/Teensy4/TMR/TMR.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+static size_t allocations = 0; // heap allocations of the test binary
+// not inlined: GCC would pair the inlined malloc with the free of the sized delete (-Wmismatched-new-delete)
+__attribute__((noinline)) void* operator new(std::size_t n) {
+    allocations++;
+    if (void* p = std::malloc(n != 0 ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void* p) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+#endif
 
 void test_pos_initialized() {
     TS4::Stepper stepper(/*stepPin*/ 0, /*dirPin*/ 1);
@@ -8,8 +30,980 @@ void test_pos_initialized() {
     TEST_ASSERT_EQUAL_INT(0, stepper.getPosition());
 }
 
+void test_intramp_follows_profile() {
+    TS4::IntRamp ramp;
+    ramp.start(200 * 200, 2 * 5'000, 10'000);
+    uint32_t p0 = ramp.period;
+
+    while (ramp.m < ramp.mTgt) {
+        int32_t m = ramp.m;
+        ramp.accelerate();
+        float exact = TS4::timerClock / sqrtf(2.0f * 5'000 * (m + 1));
+        TEST_ASSERT_FLOAT_WITHIN(exact * 0.003f, exact, ramp.period);
+    }
+    TEST_ASSERT_EQUAL_UINT32(TS4::timerClock / 10'000, ramp.period);
+
+    while (ramp.m > ramp.mMin) ramp.decelerate();
+    TEST_ASSERT_UINT32_WITHIN(p0 / 200, p0, ramp.period);
+}
+
+void test_ramp_cache_bounded() {
+    TEST_ASSERT_TRUE(TS4::RampCache::preload(50'000, 10'000));
+    TEST_ASSERT_FALSE(TS4::RampCache::preload(1'000, 100'000)); // ramp too long for a table
+
+    TS4::RampTable* t = TS4::RampCache::acquire(50'000, 8'000);
+    TEST_ASSERT_NOT_NULL(t);
+    TEST_ASSERT_EQUAL_UINT32(TS4::rampPeriod(50'000, 100), t->periods[100]);
+    TS4::RampCache::release(t);
+
+    TEST_ASSERT_LESS_OR_EQUAL(TS4::RampCache::memoryLimit(), TS4::RampCache::memoryUsage());
+}
+
+#if defined(TS4_HOST)
+void test_sim_move_timing() {
+    TS4::Stepper stepper(2, 3);
+    stepper.setMaxSpeed(10'000).setAcceleration(50'000);
+
+    TS4::SimTrace::clear();
+    stepper.moveAbs(2'000);
+
+    const auto& trace = TS4::SimTrace::pin(2);
+    TEST_ASSERT_EQUAL_INT(2'000, stepper.getPosition());
+    TEST_ASSERT_EQUAL_UINT32(2'000, trace.rising);
+
+    auto edges = trace.edges();
+    uint64_t minPeriod = UINT64_MAX;
+    for (size_t i = 1; i < edges.size(); i++) minPeriod = std::min(minPeriod, edges[i] - edges[i - 1]);
+    TEST_ASSERT_UINT32_WITHIN(1'000, 100'000, minPeriod); // 10kHz within 1%
+}
+
+void test_sim_queue_chains_moves() {
+    TS4::Stepper stepper(2, 3);
+    stepper.setMaxSpeed(10'000).setAcceleration(50'000);
+
+    TS4::SimTrace::clear();
+    TEST_ASSERT_TRUE(stepper.queueMoveAbs(1'000));
+    TEST_ASSERT_TRUE(stepper.queueMoveAbs(2'000));
+    TEST_ASSERT_TRUE(stepper.queueMoveRel(1'000));
+    TEST_ASSERT_TRUE(TS4::SimClock::runUntilIdle());
+    TEST_ASSERT_EQUAL_INT(3'000, stepper.getPosition());
+
+    auto edges = TS4::SimTrace::pin(2).edges();
+    TEST_ASSERT_EQUAL_UINT32(3'000, edges.size());
+    for (size_t i = 1'001; i < 2'001; i++) TEST_ASSERT_UINT32_WITHIN(1'000, 100'000, edges[i] - edges[i - 1]); // no stop at the junctions
+}
+
+void test_sim_scurve_move() {
+    TS4::Stepper stepper(2, 3);
+    stepper.setMaxSpeed(10'000).setAcceleration(50'000);
+
+    uint64_t start = TS4::SimClock::now();
+    stepper.moveAbsAsync(3'000);
+    TEST_ASSERT_TRUE(TS4::SimClock::runUntilIdle());
+    uint64_t trapezoid = TS4::SimClock::now() - start;
+
+    TS4::SimTrace::clear();
+    stepper.setJerk(1'000'000);
+    start = TS4::SimClock::now();
+    stepper.moveAbsAsync(0);
+    TEST_ASSERT_TRUE(TS4::SimClock::runUntilIdle());
+    uint64_t sCurve = TS4::SimClock::now() - start;
+
+    TEST_ASSERT_EQUAL_INT(0, stepper.getPosition());
+    TEST_ASSERT_EQUAL_UINT32(3'000, TS4::SimTrace::pin(2).rising);
+    TEST_ASSERT_TRUE(sCurve > trapezoid && sCurve < trapezoid + 50'000'000); // a/j = 50ms slower at most
+}
+
+void test_sim_group_batched_pins() {
+    TS4::Stepper x(8, 9), y(10, 11), z(12, 13);
+    x.setMaxSpeed(10'000).setAcceleration(50'000);
+    x.setTargetAbs(1'000);
+    y.setTargetAbs(-300);
+    z.setTargetAbs(700);
+
+    TS4::SimTrace::clear();
+    TS4::StepperGroup{x, y, z}.move();
+    TEST_ASSERT_EQUAL_INT(1'000, x.getPosition());
+    TEST_ASSERT_EQUAL_INT(-300, y.getPosition());
+    TEST_ASSERT_EQUAL_INT(700, z.getPosition());
+
+    auto lead  = TS4::SimTrace::pin(8).edges();
+    auto slave = TS4::SimTrace::pin(12).edges();
+    TEST_ASSERT_EQUAL_UINT32(700, slave.size());
+    for (uint64_t t : slave) TEST_ASSERT_TRUE(std::binary_search(lead.begin(), lead.end(), t)); // pulses start together with the lead pulse
+}
+
+void test_sim_group_start_latency() {
+    using clock = std::chrono::steady_clock;
+    TS4::Stepper x(8, 9), y(10, 11), z(12, 13);
+    x.setMaxSpeed(10'000).setAcceleration(50'000);
+
+    constexpr int runs = 100;
+    uint64_t total = 0, worst = 0;
+    for (int i = 0; i < runs; i++) {
+        int32_t d = i % 2 == 0 ? 1 : -1;
+        x.setTargetAbs(x.getPosition() + d * 100);
+        y.setTargetAbs(y.getPosition() - d * 30);
+        z.setTargetAbs(z.getPosition() + d * 70);
+
+        TS4::SimTrace::clear(); // no trace allocations for the first edges
+        size_t before       = allocations;
+        clock::time_point t = clock::now();
+        TS4::StepperGroup group{x, y, z}; // built on the fly, as in examples/02_groups
+        group.startMove();                // the first step edge is scheduled before startMove returns
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - t).count();
+
+        TEST_ASSERT_EQUAL_INT(before, allocations);
+        TS4::SimClock::run(10'000);
+        TEST_ASSERT_EQUAL_UINT32(1, TS4::SimTrace::pin(8).rising);
+        uint64_t dirEdge = 0; // if a direction changed, the first step waits for the setup time
+        for (unsigned pin : {9, 11, 13})
+            if (TS4::SimTrace::pin(pin).count > 0) dirEdge = std::max(dirEdge, TS4::SimTrace::pin(pin).firstEdge);
+        if (dirEdge != 0) TEST_ASSERT_EQUAL_UINT32(TS4_DIR_SETUP_US * 1'000, TS4::SimTrace::pin(8).firstEdge - dirEdge);
+        total += ns;
+        worst = std::max(worst, ns);
+        TEST_ASSERT_TRUE(TS4::SimClock::runUntilIdle());
+    }
+    TEST_ASSERT_EQUAL_INT(0, x.getPosition());
+
+    char msg[80];
+    snprintf(msg, sizeof(msg), "group start: %u ns mean, %u ns max (host)", unsigned(total / runs), unsigned(worst));
+    TEST_MESSAGE(msg);
+}
+
+void test_sim_group_lead_handover() {
+    TS4::Stepper x(70, 71), y(72, 73); // untraced pins, the trace allocates
+    for (TS4::Stepper* s : {&x, &y}) s->setMaxSpeed(8'000).setRampEngine(TS4::Stepper::rampEngine_t::integer);
+    x.setAcceleration(40'000);
+    y.setAcceleration(30'000); // ramp of the second block not cached
+    TS4::StepperGroup group{x, y};
+
+    x.setTargetAbs(2'000); // x leads
+    y.setTargetAbs(500);
+    TEST_ASSERT_TRUE(group.queueMove());
+    x.setTargetAbs(2'500); // y leads, continues on the timer of x
+    y.setTargetAbs(3'000);
+    TEST_ASSERT_TRUE(group.queueMove());
+    TS4::MoveToken token = group.lastMove();
+
+    size_t heap = allocations;
+    while (!y.isMoving) TS4::SimClock::run(1'000);
+    TEST_ASSERT_FALSE(x.isMoving);
+    TEST_ASSERT_TRUE(TS4::SimClock::runUntilIdle());
+    TEST_ASSERT_EQUAL_UINT32(heap, allocations); // no timer, table or tick slot taken in the step ISR
+    TEST_ASSERT_TRUE(token.done());
+    TEST_ASSERT_EQUAL_INT(2'500, x.getPosition());
+    TEST_ASSERT_EQUAL_INT(3'000, y.getPosition());
+}
+
+void test_sim_group_ramp_cache() {
+    TS4::Stepper x(74, 75), y(76, 77);
+    for (TS4::Stepper* s : {&x, &y}) s->setRampEngine(TS4::Stepper::rampEngine_t::integer).setMaxSpeed(9'000).setAcceleration(70'000); // builds the table
+    TS4::StepperGroup group{x, y};
+
+    uint32_t hits = TS4::RampCache::hits(), misses = TS4::RampCache::misses();
+    x.setTargetAbs(1'300); // x leads
+    y.setTargetAbs(200);
+    TEST_ASSERT_TRUE(group.queueMove());
+    x.setTargetAbs(1'600); // y leads
+    y.setTargetAbs(1'600);
+    TEST_ASSERT_TRUE(group.queueMove());
+    TEST_ASSERT_TRUE(TS4::SimClock::runUntilIdle());
+    TEST_ASSERT_EQUAL_UINT32(hits + 2, TS4::RampCache::hits()); // acc · length / d · d / length = 69999.99: rounded, not truncated
+    TEST_ASSERT_EQUAL_UINT32(misses, TS4::RampCache::misses());
+    TEST_ASSERT_EQUAL_INT(1'600, y.getPosition());
+}
+
+void test_sim_group_size_limit() {
+    static_assert(31 + 2 * TS4_MAX_GROUP_SIZE < 64, "the simulation traces 64 pins");
+    TS4::Stepper* steppers[TS4_MAX_GROUP_SIZE + 1];
+    for (unsigned i = 0; i <= TS4_MAX_GROUP_SIZE; i++)
+    {
+        steppers[i] = new TS4::Stepper(30 + 2 * i, 31 + 2 * i);
+        steppers[i]->setTargetAbs(100);
+    }
+
+    TS4::StepperGroup group;
+    TEST_ASSERT_TRUE(group.add(steppers, TS4_MAX_GROUP_SIZE));
+    TEST_ASSERT_FALSE(group.add(*steppers[TS4_MAX_GROUP_SIZE])); // would be left behind
+    TEST_ASSERT_TRUE(group.startMove().done());
+    TEST_ASSERT_FALSE(group.queueMove());
+    TEST_ASSERT_FALSE(steppers[0]->isMoving);
+    TEST_ASSERT_EQUAL_INT(0, steppers[0]->getPosition());
+
+    group.clear();
+    TEST_ASSERT_TRUE(group.add(steppers, TS4_MAX_GROUP_SIZE));
+    group.move();
+    TEST_ASSERT_EQUAL_INT(100, steppers[TS4_MAX_GROUP_SIZE - 1]->getPosition());
+    for (TS4::Stepper* s : steppers) delete s;
+}
+
+void test_sim_dir_setup_scheduled() {
+    TS4::Stepper x(4, 5);
+    x.setMaxSpeed(5'000).setAcceleration(50'000);
+    x.setRampEngine(TS4::Stepper::rampEngine_t::integer);
+
+    TS4::SimTrace::clear();
+    x.rotateAsync(5'000);
+    delay(200);
+    x.rotateAsync(-5'000); // reverses at the start speed
+    delay(400);
+    x.stopAsync();
+    TEST_ASSERT_TRUE(TS4::SimClock::runUntilIdle());
+
+    auto dirEdges  = TS4::SimTrace::pin(5).edges(true);
+    auto dirFalls  = TS4::SimTrace::pin(5).edges(false);
+    auto stepEdges = TS4::SimTrace::pin(4).edges();
+    TEST_ASSERT_EQUAL_INT(1, dirEdges.size()); // written once per direction change only
+    TEST_ASSERT_EQUAL_INT(1, dirFalls.size());
+    auto next = std::lower_bound(stepEdges.begin(), stepEdges.end(), dirFalls[0]);
+    TEST_ASSERT_TRUE(next != stepEdges.end());
+    TEST_ASSERT_TRUE(*next - dirFalls[0] >= TS4_DIR_SETUP_US * 1'000);
+    TEST_ASSERT_TRUE(*(next - 1) < dirFalls[0]); // no step lost or added around the reversal
+}
+
+struct DoneLog {
+    int calls = 0;
+    uint64_t at = 0;
+    static void done(void* ctx) {
+        auto log = static_cast<DoneLog*>(ctx);
+        log->calls++;
+        log->at = TS4::SimClock::now();
+    }
+};
+
+void test_sim_done_callbacks() {
+    TS4::Stepper x(20, 21), y(22, 23);
+    x.setMaxSpeed(10'000).setAcceleration(50'000);
+    y.setMaxSpeed(10'000).setAcceleration(50'000);
+
+    DoneLog log;
+    x.onDone(DoneLog::done, &log); // called from the step ISR
+    x.moveAbs(500);
+    TEST_ASSERT_EQUAL_INT(1, log.calls);
+    TEST_ASSERT_TRUE(TS4::SimClock::now() - log.at <= 1'000); // returns within a yield() of the stop
+
+    TEST_ASSERT_TRUE(x.queueMoveAbs(1'000));
+    TS4::MoveToken first = x.lastMove();
+    TEST_ASSERT_TRUE(x.queueMoveAbs(2'000));
+    TS4::MoveToken second = x.lastMove();
+    first.wait();
+    TEST_ASSERT_INT_WITHIN(1, 1'000, x.getPosition()); // done at the junction, the same ISR steps on
+    TEST_ASSERT_FALSE(second.done());
+    second.wait();
+    TEST_ASSERT_EQUAL_INT(2, log.calls); // once per stop, not per queued move
+    TEST_ASSERT_FALSE(x.isMoving);
+
+    TS4::StepperGroup group{x, y};
+    DoneLog groupLog;
+    group.onDone(DoneLog::done, &groupLog, true);
+    x.setTargetAbs(3'000); // x leads
+    y.setTargetAbs(500);
+    TEST_ASSERT_TRUE(group.queueMove());
+    y.setTargetAbs(3'000); // y leads
+    TEST_ASSERT_TRUE(group.queueMove());
+    TS4::MoveToken path = group.lastMove();
+    TEST_ASSERT_TRUE(TS4::SimClock::runUntilIdle());
+    TEST_ASSERT_TRUE(path.done());
+    TEST_ASSERT_EQUAL_INT(0, groupLog.calls); // deferred
+    TS4::handleEvents();
+    TEST_ASSERT_EQUAL_INT(1, groupLog.calls);
+    TEST_ASSERT_EQUAL_INT(3, log.calls); // x stopped when y took over
+
+    TS4::handleEvents();
+    TEST_ASSERT_EQUAL_INT(1, groupLog.calls);
+    TEST_ASSERT_TRUE(TS4::MoveToken().done());
+}
+
+void test_sim_position_events() {
+    TS4::Stepper x(24, 25), y(26, 27);
+    x.setMaxSpeed(10'000).setAcceleration(50'000);
+
+    static volatile uint32_t passes = 0;
+    static uint64_t at              = 0;
+    TEST_ASSERT_TRUE(x.onPosition(100, passes));
+    TEST_ASSERT_TRUE(x.onPosition(-50, passes)); // reached on the way back
+    TEST_ASSERT_TRUE(x.onPosition(700, [](void*) { at = TS4::SimClock::now(); }));
+    TEST_ASSERT_TRUE(y.onPosition(-200, 30, HIGH)); // y is a dependent stepper
+    TEST_ASSERT_EQUAL_UINT32(4, x.positionEvents() + y.positionEvents());
+
+    x.setTargetAbs(1'000);
+    y.setTargetAbs(-300);
+    TS4::SimTrace::clear();
+    TS4::StepperGroup group{x, y};
+    group.move();
+    TEST_ASSERT_EQUAL_UINT32(1, passes);
+    TEST_ASSERT_EQUAL_UINT32(1, TS4::SimTrace::pin(30).rising);
+    TEST_ASSERT_TRUE(TS4::SimTrace::pin(26).edges()[199] == TS4::SimTrace::pin(30).firstEdge); // with the 200th step of y
+    TEST_ASSERT_TRUE(TS4::SimTrace::pin(24).edges()[699] == at);
+
+    x.moveAbs(-100);
+    TEST_ASSERT_EQUAL_UINT32(2, passes); // 100 doesn't fire again
+    TEST_ASSERT_EQUAL_UINT32(0, x.positionEvents() + y.positionEvents());
+}
+
+void test_sim_gearing() {
+    TS4::Stepper master(32, 33), y(34, 35), z(36, 37);
+    master.setMaxSpeed(10'000).setAcceleration(50'000);
+
+    TS4::Gearing gears;
+    TEST_ASSERT_TRUE(gears.attach(master));
+    TEST_ASSERT_TRUE(gears.addFollower(y, 1, 3));
+    TEST_ASSERT_TRUE(gears.addFollower(z, -2, 3));
+    TEST_ASSERT_FALSE(gears.addFollower(z, 1, 2)); // already geared
+    TEST_ASSERT_FALSE(gears.setRatio(y, 4, 3));     // faster than the master
+
+    TS4::SimTrace::clear();
+    master.moveAbs(900);
+    TEST_ASSERT_EQUAL_INT(300, y.getPosition());
+    TEST_ASSERT_EQUAL_INT(-600, z.getPosition());
+    auto lead = TS4::SimTrace::pin(32).edges();
+    for (uint64_t t : TS4::SimTrace::pin(36).edges()) TEST_ASSERT_TRUE(std::binary_search(lead.begin(), lead.end(), t)); // with the master steps
+
+    master.moveAbs(0); // followers reverse with the master, no fraction lost
+    TEST_ASSERT_EQUAL_INT(0, y.getPosition());
+    TEST_ASSERT_EQUAL_INT(0, z.getPosition());
+    auto zDir  = TS4::SimTrace::pin(37).edges(true);
+    auto zStep = TS4::SimTrace::pin(36).edges();
+    TEST_ASSERT_EQUAL_INT(1, zDir.size());
+    auto next = std::lower_bound(zStep.begin(), zStep.end(), zDir[0]);
+    TEST_ASSERT_TRUE(*next - zDir[0] >= TS4_DIR_SETUP_US * 1'000);
+
+    master.moveAbsAsync(3'000);
+    while (master.getPosition() < 1'200) yield();
+    TEST_ASSERT_TRUE(gears.setRatio(y, 1, 2)); // on the fly
+    int32_t switched = master.getPosition();
+    master.lastMove().wait();
+    TEST_ASSERT_INT_WITHIN(1, switched / 3 + (3'000 - switched) / 2, y.getPosition());
+
+    gears.detach();
+    master.moveAbs(0);
+    TEST_ASSERT_EQUAL_INT(-2'000, z.getPosition()); // untouched after detach
+}
+
+void test_sim_velocity_stream() {
+    TS4::Stepper x(38, 39);
+    x.setMaxSpeed(20'000).setAcceleration(100'000);
+
+    TS4::SimTrace::clear();
+    uint32_t t0 = micros();
+    for (int k = 0; k <= 200; k++) { // 1kHz control loop: 0 → 10kHz in 100ms, then hold
+        while (!x.streamVelocity(std::min(k, 100) * 100, micros() + 2'000)) delay(1);
+        delay(1);
+    }
+    uint32_t tLast = micros();
+    TEST_ASSERT_TRUE(x.isMoving);
+    TEST_ASSERT_TRUE(TS4::SimClock::runUntilIdle()); // underrun: holds, ramps down and stops
+    TEST_ASSERT_FALSE(x.isMoving);
+
+    auto edges = TS4::SimTrace::pin(38).edges();
+    TEST_ASSERT_EQUAL_UINT32(edges.size(), x.getPosition());
+    auto at = [&](uint32_t us) { return std::lower_bound(edges.begin(), edges.end(), uint64_t(us) * 1'000); };
+    auto cruise = at(t0 + 150'000);
+    TEST_ASSERT_UINT32_WITHIN(1'000, 100'000, *(cruise + 1) - *cruise); // 10kHz
+    auto ramp = at(t0 + 52'000); // setpoint 5kHz at 50ms, tracked with the 2ms lead
+    TEST_ASSERT_UINT32_WITHIN(10'000, 200'000, *(ramp + 1) - *ramp);
+    for (size_t i = 2; i < edges.size(); i++) { // speed changes are limited by the acceleration
+        double v1 = 1e9 / (edges[i - 1] - edges[i - 2]), v2 = 1e9 / (edges[i] - edges[i - 1]); // mean speeds of two steps
+        TEST_ASSERT_TRUE(std::abs(v2 - v1) <= 100'000 * (edges[i] - edges[i - 2]) * 0.5e-9 * 1.1 + 1); // + rounding to timer ticks
+    }
+    TEST_ASSERT_TRUE(edges.back() > uint64_t(tLast + 2'000 + TS4_VELOCITY_HOLD_US) * 1'000); // held
+    TEST_ASSERT_TRUE(edges.back() < uint64_t(tLast + 2'000 + TS4_VELOCITY_HOLD_US + 110'000) * 1'000); // 10kHz → 0 takes 100ms
+
+    int32_t p = x.getPosition();
+    TS4::SimTrace::clear();
+    TEST_ASSERT_TRUE(x.streamVelocity(-5'000)); // reverses the dir pin before the first step
+    delay(10);
+    x.stopAsync();
+    TEST_ASSERT_FALSE(x.streamVelocity(1'000)); // stopping
+    TEST_ASSERT_TRUE(TS4::SimClock::runUntilIdle());
+    TEST_ASSERT_TRUE(x.getPosition() < p);
+    TEST_ASSERT_TRUE(TS4::SimTrace::pin(38).firstEdge - TS4::SimTrace::pin(39).firstEdge >= TS4_DIR_SETUP_US * 1'000);
+}
+
+void test_sim_profile_tick() {
+    TS4::Stepper x(42, 43);
+    x.setMaxSpeed(50'000).setAcceleration(200'000);
+
+    uint64_t start = TS4::SimClock::now();
+    x.moveAbs(20'000);
+    uint64_t perStep = TS4::SimClock::now() - start;
+
+    x.setRampEngine(TS4::Stepper::rampEngine_t::tick);
+    TS4::SimTrace::clear();
+    start = TS4::SimClock::now();
+    x.moveAbs(0);
+    uint64_t ticked = TS4::SimClock::now() - start;
+
+    TEST_ASSERT_EQUAL_INT(0, x.getPosition());
+    TEST_ASSERT_EQUAL_UINT32(20'000, TS4::SimTrace::pin(42).rising);
+    TEST_ASSERT_FLOAT_WITHIN(0.02, 1.0, (double)ticked / perStep); // same profile
+    auto edges = TS4::SimTrace::pin(42).edges();
+    uint64_t minPeriod = UINT64_MAX;
+    for (size_t i = 1; i < edges.size(); i++) minPeriod = std::min(minPeriod, edges[i] - edges[i - 1]);
+    TEST_ASSERT_UINT32_WITHIN(200, 20'000, minPeriod); // 50kHz
+
+    TS4::SimTrace::clear();
+    x.rotateAsync(20'000);
+    delay(150);
+    x.rotateAsync(-20'000); // reverses at the start speed
+    delay(300);
+    x.stopAsync();
+    TEST_ASSERT_TRUE(TS4::SimClock::runUntilIdle()); // the tick timer stops with the last stepper
+    TEST_ASSERT_FALSE(x.isMoving);
+    TEST_ASSERT_EQUAL_INT(1, TS4::SimTrace::pin(43).edges(false).size());
+    TEST_ASSERT_TRUE(x.getPosition() < 0);
+
+    static int slots[TS4_TICK_SLOTS]; // all slots in use: the next move falls back to the sqrt engine
+    for (int& slot : slots) TEST_ASSERT_TRUE(TS4::ProfileTick::add([](void*) {}, &slot));
+    x.moveRelAsync(100);
+    TEST_ASSERT_TRUE(x.getRampEngine() == TS4::Stepper::rampEngine_t::sqrt);
+    for (int& slot : slots) TS4::ProfileTick::remove(&slot);
+    TEST_ASSERT_TRUE(TS4::SimClock::runUntilIdle());
+    TEST_ASSERT_TRUE(x.getRampEngine() == TS4::Stepper::rampEngine_t::tick); // for that move only
+}
+
+static uint64_t runPolygon(float junctionDeviation) {
+    TS4::Stepper x(4, 5), y(6, 7);
+    x.setMaxSpeed(10'000).setAcceleration(50'000);
+    y.setMaxSpeed(10'000).setAcceleration(50'000);
+    x.setPosition(1'000);
+
+    TS4::StepperGroup group{x, y};
+    group.setJunctionDeviation(junctionDeviation);
+
+    uint64_t start = TS4::SimClock::now();
+    for (int k = 1; k <= 36; k++) { // 36-gon, more points than fit into the queue
+        x.setTargetAbs(lroundf(1'000 * cosf(k * 2 * PI / 36)));
+        y.setTargetAbs(lroundf(1'000 * sinf(k * 2 * PI / 36)));
+        while (!group.queueMove()) delay(1);
+    }
+    TEST_ASSERT_TRUE(TS4::SimClock::runUntilIdle());
+    TEST_ASSERT_EQUAL_INT(1'000, x.getPosition());
+    TEST_ASSERT_EQUAL_INT(0, y.getPosition());
+    return TS4::SimClock::now() - start;
+}
+
+void test_sim_planner_corner_speed() {
+    uint64_t stopAtCorners = runPolygon(0);
+    uint64_t planned       = runPolygon(1.0f);
+    TEST_ASSERT_TRUE(planned < stopAtCorners / 2);
+}
+
+void test_sim_group_feed_rate_arc() {
+    TS4::Stepper x(4, 5), y(6, 7), z(8, 9);
+    for (TS4::Stepper* s : {&x, &y, &z}) s->setMaxSpeed(20'000).setAcceleration(100'000);
+    TS4::StepperGroup group{x, y, z};
+    group.setFeedRate(5'000);
+
+    x.setTargetAbs(3'000); // path length 5'000
+    y.setTargetAbs(4'000);
+    z.setTargetAbs(0);
+    TS4::SimTrace::clear();
+    group.move();
+    auto lead = TS4::SimTrace::pin(6).edges();
+    TEST_ASSERT_UINT32_WITHIN(1'000, 250'000, lead[2'000] - lead[1'999]); // y runs at 4/5 of the feed rate
+
+    x.setTargetAbs(1'000);
+    group.move();
+    z.setTargetAbs(400); // full circle around (0, 4'000) with a 400 step helix
+    uint64_t t0 = TS4::SimClock::now();
+    TEST_ASSERT_TRUE(group.queueArc(0, 4'000, true));
+    TS4::MoveToken token = group.lastMove();
+
+    float maxError = 0, angle = 0, lastAngle = 0;
+    while (!token.done())
+    {
+        yield();
+        float dx = x.getPosition(), dy = y.getPosition() - 4'000;
+        float a  = atan2f(dy, dx);
+        maxError = std::max(maxError, std::abs(sqrtf(dx * dx + dy * dy) - 1'000));
+        angle += std::remainder(a - lastAngle, 2 * PI);
+        lastAngle = a;
+    }
+    TEST_ASSERT_EQUAL_INT(1'000, x.getPosition());
+    TEST_ASSERT_EQUAL_INT(4'000, y.getPosition());
+    TEST_ASSERT_EQUAL_INT(400, z.getPosition());
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 2 * PI, angle);
+    TEST_ASSERT_TRUE(maxError < 1.0f); // the midpoint steps follow the circle
+    double seconds = (TS4::SimClock::now() - t0) * 1e-9;
+    TEST_ASSERT_FLOAT_WITHIN(0.02, 2 * PI * 1'000 / 5'000 + 5'000.0 / 100'000, seconds); // feed rate along the whole arc, one ramp up and down
+}
+
+void test_sim_gcode_stream() {
+    TS4::Stepper x(20, 21), y(22, 23);
+    for (TS4::Stepper* s : {&x, &y}) s->setMaxSpeed(20'000).setAcceleration(100'000);
+    TS4::StepperGroup group{x, y};
+
+    static TS4::GCodeParser parser;
+    TS4::GCodeInterpreter gcode(group);
+    gcode.attachAxis('X', x, 100); // steps/mm
+    gcode.attachAxis('Y', y, 100);
+    static unsigned ok, errors;
+    ok = errors = 0;
+    gcode.onLine([](void*, bool success) { (success ? ok : errors)++; });
+
+    const char program[] = "G91 G1 X10 Y5 F3000 ; relative\n"
+                           "(comment) X-2.5\n"
+                           "N3 G4 P0.05*71\n"
+                           "g90 g0 x0 y0\n"
+                           "M3\n"
+                           "G92 X1\n";
+    TEST_ASSERT_EQUAL_UINT32(sizeof(program) - 1, parser.write(program, sizeof(program) - 1));
+
+    TS4::SimTrace::clear();
+    size_t heap = allocations;
+    TEST_ASSERT_EQUAL_UINT32(2, gcode.poll(parser)); // moves are queued, the dwell waits for them
+    TEST_ASSERT_EQUAL_UINT32(heap, allocations);
+    while (ok + errors < 6)
+    {
+        delay(1);
+        gcode.poll(parser);
+    }
+    TEST_ASSERT_EQUAL_UINT32(5, ok);
+    TEST_ASSERT_EQUAL_UINT32(1, errors);
+    TEST_ASSERT_TRUE(TS4::SimClock::runUntilIdle());
+    TEST_ASSERT_EQUAL_INT(100, x.getPosition());
+    TEST_ASSERT_EQUAL_INT(0, y.getPosition());
+
+    auto edges = TS4::SimTrace::pin(20).edges();
+    TEST_ASSERT_UINT32_WITHIN(1'000, 223'607, edges[500] - edges[499]); // F3000 = 5'000 steps/s along the path, x: 2/sqrt(5) of it
+    uint64_t pause = 0;
+    for (size_t i = 1; i < edges.size(); i++) pause = std::max(pause, edges[i] - edges[i - 1]);
+    TEST_ASSERT_TRUE(pause >= 50'000'000 && pause < 60'000'000); // G4 P0.05 plus the last and the first step period
+}
+
+void test_gcode_parser_limits() {
+    static TS4::GCodeParser parser;
+    TS4::GCodeLine line;
+
+    const char decimals[] = "G1 X0.0000000000125 Y-1.25000000000001\n"; // more decimals than a float holds
+    parser.write(decimals, sizeof(decimals) - 1);
+    TEST_ASSERT_TRUE(parser.next(line));
+    TEST_ASSERT_FALSE(line.error);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.0, line.axis[0]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, -1.25, line.axis[1]);
+
+    // a line longer than the buffer is one error, its tail must not run as a line of its own
+    std::string text = "G1 X1" + std::string(TS4_GCODE_BUFFER, ' ') + "Y5\nG1 X2\n";
+    unsigned written = 0, lines = 0, errors = 0;
+    while (written < text.size())
+    {
+        written += parser.write(text.data() + written, text.size() - written);
+        while (parser.next(line))
+        {
+            lines++;
+            if (line.error) errors++;
+            else TEST_ASSERT_FLOAT_WITHIN(1e-6, 2.0, line.axis[0]);
+            TEST_ASSERT_FALSE(line.axes & 2);
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(2, lines);
+    TEST_ASSERT_EQUAL_UINT32(1, errors);
+}
+
+#if defined(TS4_PROFILE) // built by the native_profile environment
+void test_sim_isr_profile() {
+    TS4::Stepper x(4, 5);
+    x.setMaxSpeed(20'000).setAcceleration(100'000);
+    x.clearIsrStats();
+    TS4::IsrStats module = *TS4::TimerFactory::getModuleStats(0);
+
+    x.moveRel(500);
+    const TS4::IsrStats& step = x.getStepIsrStats();
+    TEST_ASSERT_EQUAL_UINT32(500, step.steps);
+    TEST_ASSERT_TRUE(step.calls >= 500 && step.calls <= 502); // + the call ending the move (+ a postponed first step)
+    TEST_ASSERT_EQUAL_UINT32(500, x.getResetIsrStats().calls);
+    TEST_ASSERT_TRUE(step.maxTime > 0 && step.meanTime() <= step.maxTime);
+    uint32_t binned = 0;
+    for (uint32_t n : step.histogram) binned += n;
+    TEST_ASSERT_EQUAL_UINT32(step.calls, binned);
+
+    TEST_ASSERT_EQUAL_UINT32(1, TS4::TimerFactory::moduleCount());
+    TEST_ASSERT_TRUE(TS4::TimerFactory::getModuleStats(0)->calls >= module.calls + 1'000); // pulse and pause phases
+}
+#endif
+
+void test_sim_record_replay() {
+    TS4::Stepper x(20, 21), y(22, 23);
+    for (TS4::Stepper* s : {&x, &y}) s->setMaxSpeed(20'000).setAcceleration(100'000);
+    TS4::StepperGroup group{x, y};
+
+    static uint8_t buffer[16 * 1024];
+    TS4::StepRecording recording(buffer, sizeof(buffer));
+    TS4::StepRecorder recorder;
+    recorder.addAxis(x);
+    recorder.addAxis(y);
+
+    TS4::SimTrace::clear();
+    TEST_ASSERT_TRUE(recorder.begin(recording));
+    x.setTargetAbs(3'000);
+    y.setTargetAbs(1'000);
+    group.move();
+    auto recorded = TS4::SimTrace::pin(20).edges();
+    x.setTargetAbs(2'000);
+    y.setTargetAbs(-500);
+    group.move();
+    recorder.end();
+    TEST_ASSERT_TRUE(recording.valid());
+    TEST_ASSERT_EQUAL_UINT32(4'500, recording.steps()); // lead steps, y leads the second move
+    TEST_ASSERT_TRUE(recording.size() < 3 * recording.steps()); // delta encoded
+
+    static uint8_t copy[sizeof(buffer)]; // e.g. generated on a host and uploaded
+    memcpy(copy, recording.data(), recording.size());
+    TS4::StepRecording uploaded(copy, sizeof(copy));
+    TEST_ASSERT_TRUE(uploaded.load(recording.size()));
+    TEST_ASSERT_EQUAL_UINT32(recording.steps(), uploaded.steps());
+    copy[6] |= 0x80; // moving axis which isn't in the recording
+    TEST_ASSERT_FALSE(uploaded.load(recording.size()));
+    copy[6] &= ~0x80;
+    copy[12]--; // payload ends within the last record or after fewer steps than the header says
+    TEST_ASSERT_FALSE(uploaded.load(recording.size()));
+    copy[12]++;
+    TEST_ASSERT_TRUE(uploaded.load(recording.size()));
+
+    x.setPosition(0);
+    y.setPosition(0);
+    TS4::StepPlayer player;
+    player.addAxis(x);
+    player.addAxis(y);
+
+    TS4::SimTrace::clear();
+    size_t heap           = allocations;
+    TS4::MoveToken replay = player.play(uploaded);
+    TEST_ASSERT_EQUAL_UINT32(heap, allocations);
+    TEST_ASSERT_FALSE(replay.done());
+    TEST_ASSERT_TRUE(player.isPlaying());
+    TEST_ASSERT_TRUE(x.moveAbsAsync(0).done()); // refused while replaying
+    TEST_ASSERT_FALSE(group.queueMove());
+    TEST_ASSERT_TRUE(TS4::SimClock::runUntilIdle());
+    TEST_ASSERT_TRUE(replay.done());
+    TEST_ASSERT_EQUAL_INT(2'000, x.getPosition());
+    TEST_ASSERT_EQUAL_INT(-500, y.getPosition());
+    TEST_ASSERT_EQUAL_UINT32(4'000, TS4::SimTrace::pin(20).rising);
+    TEST_ASSERT_EQUAL_UINT32(2'500, TS4::SimTrace::pin(22).rising);
+
+    auto played = TS4::SimTrace::pin(20).edges();
+    for (size_t i = 1; i < recorded.size(); i++) TEST_ASSERT_EQUAL_UINT32(recorded[i] - recorded[i - 1], played[i] - played[i - 1]); // same intervals as recorded
+
+    TS4::SimTrace::clear();
+    player.play(recording, 2.0f); // half speed
+    TEST_ASSERT_TRUE(TS4::SimClock::runUntilIdle());
+    TEST_ASSERT_EQUAL_INT(4'000, x.getPosition());
+    auto slow = TS4::SimTrace::pin(20).edges();
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 2.0, (double)(slow.back() - slow.front()) / (played.back() - played.front()));
+
+    replay = player.play(recording);
+    TS4::SimClock::run(20'000'000);
+    y.emergencyStop(); // ends the replay of both axes
+    TEST_ASSERT_TRUE(replay.done());
+    TEST_ASSERT_FALSE(player.isPlaying());
+    int32_t stopped = x.getPosition();
+    TEST_ASSERT_TRUE(stopped > 4'000 && stopped < 8'000);
+    TEST_ASSERT_TRUE(TS4::SimClock::runUntilIdle());
+    TEST_ASSERT_EQUAL_INT(stopped, x.getPosition());
+    x.moveAbs(4'000);
+
+    TEST_ASSERT_TRUE(recorder.begin(recording)); // velocity streaming can't be recorded
+    x.streamVelocity(1'000);
+    recorder.end();
+    TEST_ASSERT_FALSE(recording.valid());
+    TEST_ASSERT_FALSE(recorder.begin(recording));
+    TEST_ASSERT_TRUE(TS4::SimClock::runUntilIdle());
+}
+
+void test_sim_group_stream() {
+    TS4::Stepper x(14, 15), y(16, 17), z(18, 19);
+    x.setMaxSpeed(10'000).setAcceleration(50'000).setRampEngine(TS4::StepperBase::rampEngine_t::integer);
+    x.setTargetAbs(5'000);
+    y.setTargetAbs(-1'200);
+    z.setTargetAbs(3'100);
+    TS4::StepperGroup group{x, y, z};
+
+    TS4::SimTrace::clear();
+    group.move();
+    auto isr = TS4::SimTrace::pin(14).edges();
+
+    static TS4::SimStream dma;
+    x.setTargetAbs(0);
+    y.setTargetAbs(0);
+    z.setTargetAbs(0);
+    TS4::SimTrace::clear();
+    TEST_ASSERT_TRUE(group.startStream(dma));
+    TEST_ASSERT_TRUE(TS4::SimClock::runUntilIdle());
+    TEST_ASSERT_FALSE(dma.isRunning());
+
+    TEST_ASSERT_EQUAL_INT(0, x.getPosition());
+    TEST_ASSERT_EQUAL_INT(0, y.getPosition());
+    TEST_ASSERT_EQUAL_INT(0, z.getPosition());
+    TEST_ASSERT_EQUAL_UINT32(5'000, TS4::SimTrace::pin(14).rising);
+    TEST_ASSERT_EQUAL_UINT32(1'200, TS4::SimTrace::pin(16).rising);
+    TEST_ASSERT_EQUAL_UINT32(3'100, TS4::SimTrace::pin(18).rising);
+    TEST_ASSERT_FALSE(TS4::SimTrace::pin(16).level);
+
+    auto dmaEdges = TS4::SimTrace::pin(14).edges();
+    double tIsr   = isr.back() - isr.front();
+    double tDma   = dmaEdges.back() - dmaEdges.front();
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 1.0, tDma / tIsr); // same profile as the interrupt driven move
+
+    TS4::Stepper w(40, 41); // different port
+    w.setTargetAbs(100);
+    x.setTargetAbs(100);
+    TS4::StepperGroup split{x, w};
+    TEST_ASSERT_FALSE(split.startStream(dma));
+}
+
+struct FakeTmr : TS4::TmrTimer { // TMR channel on a fake register block
+    using TmrTimer::TmrTimer;
+    using TmrTimer::ISR;
+    IMXRT_TMR_CH_t* registers() { return regs; }
+    int steps = 0, resets = 0, stopAfter = 3;
+    static void step(void* t) {
+        auto self = static_cast<FakeTmr*>(t);
+        self->updatePeriod(TS4::timerClock / 10'000);
+        if (++self->steps > self->stopAfter) self->stop();
+    }
+    static void reset(void* t) { static_cast<FakeTmr*>(t)->resets++; }
+};
+
+void test_tmr_hardware_pulse() {
+    IMXRT_TMR_CH_t ch{};
+    FakeTmr tmr(&ch, 19);
+    tmr.attachIsr(FakeTmr::step, FakeTmr::reset, &tmr);
+    tmr.setPulseParams(8, 19);
+    TEST_ASSERT_FALSE(tmr.usePinOutput(18));
+    TEST_ASSERT_TRUE(tmr.usePinOutput(19));
+
+    *portConfigRegister(19) = 5; // GPIO
+    tmr.start();
+    TEST_ASSERT_EQUAL_INT(1, tmr.steps);
+    TEST_ASSERT_EQUAL_UINT32(1, *portConfigRegister(19)); // OFLAG muxed to the pin
+    TEST_ASSERT_EQUAL_UINT16(TMR_CTRL_OUTMODE(4) | TMR_CTRL_LENGTH, ch.CTRL & (TMR_CTRL_OUTMODE(7) | TMR_CTRL_LENGTH));
+    TEST_ASSERT_EQUAL_UINT16(TMR_SCTRL_OEN | TMR_SCTRL_VAL | TMR_SCTRL_FORCE, ch.SCTRL);
+    TEST_ASSERT_EQUAL_UINT16(1'200 - 1, ch.COMP1);           // 8µs pulse, phases take COMPx + 1 ticks
+    TEST_ASSERT_EQUAL_UINT16(15'000 - 1'200 - 1, ch.COMP2);  // 10kHz
+    TEST_ASSERT_EQUAL_UINT16(TMR_CSCTRL_TCF1EN, ch.CSCTRL);
+
+    tmr.ISR(); // falling edges
+    tmr.ISR();
+    TEST_ASSERT_EQUAL_INT(3, tmr.steps);
+    TEST_ASSERT_EQUAL_INT(0, tmr.resets); // one interrupt per step
+    TEST_ASSERT_EQUAL_UINT16(15'000 - 1'200 - 1, ch.COMP2);
+
+    tmr.ISR(); // move done
+    TEST_ASSERT_EQUAL_UINT16(0, ch.CTRL);
+    TEST_ASSERT_EQUAL_UINT32(5, *portConfigRegister(19)); // pin handed back to the GPIO
+
+    IMXRT_TMR_CH_t ch2{}; // channel without output pin: two phase fallback
+    FakeTmr sw(&ch2);
+    sw.attachIsr(FakeTmr::step, FakeTmr::reset, &sw);
+    TEST_ASSERT_FALSE(sw.usePinOutput(19));
+    sw.start();
+    sw.ISR();
+    sw.ISR();
+    TEST_ASSERT_EQUAL_INT(2, sw.steps);
+    TEST_ASSERT_EQUAL_INT(1, sw.resets);
+}
+
+struct SetupTmr : FakeTmr { // postpones the first step by 5µs (direction setup)
+    using FakeTmr::FakeTmr;
+    bool setup = true;
+    static void step(void* t) {
+        auto self = static_cast<SetupTmr*>(t);
+        if (self->setup) {
+            self->setup = false;
+            self->postpone(750);
+            return;
+        }
+        FakeTmr::step(t);
+    }
+};
+
+void test_tmr_postponed_step() {
+    IMXRT_TMR_CH_t ch{};
+    SetupTmr tmr(&ch, 19);
+    tmr.attachIsr(SetupTmr::step, FakeTmr::reset, &tmr);
+    tmr.setPulseParams(8, 19);
+    TEST_ASSERT_TRUE(tmr.usePinOutput(19));
+    tmr.start();
+    TEST_ASSERT_EQUAL_INT(0, tmr.steps);
+    TEST_ASSERT_EQUAL_UINT16(TMR_SCTRL_OEN | TMR_SCTRL_FORCE, ch.SCTRL); // pin held low during the lead in
+    TEST_ASSERT_EQUAL_UINT16(TMR_CTRL_OUTMODE(1), ch.CTRL & TMR_CTRL_OUTMODE(7));
+    TEST_ASSERT_EQUAL_UINT16(750 - 1, ch.COMP1);
+    tmr.ISR(); // lead in done, first pulse
+    TEST_ASSERT_EQUAL_INT(1, tmr.steps);
+    TEST_ASSERT_EQUAL_UINT16(TMR_SCTRL_OEN | TMR_SCTRL_VAL | TMR_SCTRL_FORCE, ch.SCTRL);
+    TEST_ASSERT_EQUAL_UINT16(TMR_CTRL_OUTMODE(4), ch.CTRL & TMR_CTRL_OUTMODE(7));
+    TEST_ASSERT_EQUAL_UINT16(1'200 - 1, ch.COMP1);
+    tmr.stop();
+
+    IMXRT_TMR_CH_t ch2{}; // two phase mode: stepIsr is called again without a pulse phase
+    SetupTmr sw(&ch2);
+    sw.attachIsr(SetupTmr::step, FakeTmr::reset, &sw);
+    sw.setPulseParams(8, 0);
+    sw.start();
+    TEST_ASSERT_EQUAL_INT(0, sw.steps);
+    TEST_ASSERT_EQUAL_UINT16(750 - 1, ch2.COMP1);
+    sw.ISR();
+    TEST_ASSERT_EQUAL_INT(1, sw.steps);
+    TEST_ASSERT_EQUAL_INT(0, sw.resets);
+    TEST_ASSERT_EQUAL_UINT16(1'200 - 1, ch2.COMP1);
+    sw.ISR();
+    TEST_ASSERT_EQUAL_INT(1, sw.resets);
+    sw.stop();
+}
+
+struct RangeTmr : FakeTmr {
+    using FakeTmr::FakeTmr;
+    uint32_t stepPeriod;
+    uint16_t stepFrac = 0;
+    uint64_t elapsed  = 0; // timerClock ticks of the phases loaded so far
+    static void step(void* t) {
+        auto self = static_cast<RangeTmr*>(t);
+        self->updatePeriod(self->stepPeriod, self->stepFrac);
+        self->steps++;
+    }
+    void phase() { // compare event: account for the phase which just ended
+        elapsed += (uint64_t)(registers()->COMP1 + 1) << prescale;
+        ISR();
+    }
+};
+
+void test_tmr_auto_prescaler() {
+    IMXRT_TMR_CH_t ch{};
+    RangeTmr tmr(&ch);
+    tmr.attachIsr(RangeTmr::step, FakeTmr::reset, &tmr);
+
+    tmr.setPulseParams(2, 0);
+    tmr.stepPeriod = TS4::timerClock / 200'000; // 200kHz: full resolution
+    tmr.start();
+    tmr.phase(); // pulse done
+    TEST_ASSERT_EQUAL_UINT16(TMR_CTRL_PCS(0b1000), ch.CTRL & TMR_CTRL_PCS(0b1111));
+    TEST_ASSERT_EQUAL_UINT16(750 - 300 - 1, ch.COMP1);
+    tmr.phase(); // pause done
+    TEST_ASSERT_EQUAL_UINT32(750, tmr.elapsed);
+
+    tmr.setPulseParams(8, 0);
+    tmr.stepPeriod = TS4::timerClock; // 1Hz: largest prescaler plus full counter cycles
+    tmr.start();
+    tmr.elapsed = 0;
+    int steps   = tmr.steps;
+    int resets  = tmr.resets;
+    tmr.phase(); // pulse done
+    TEST_ASSERT_EQUAL_UINT16(TMR_CTRL_PCS(0b1111), ch.CTRL & TMR_CTRL_PCS(0b1111));
+    while (tmr.steps == steps) tmr.phase();
+    TEST_ASSERT_EQUAL_INT(resets + 1, tmr.resets);
+    TEST_ASSERT_UINT32_WITHIN(128, TS4::timerClock, tmr.elapsed);
+    tmr.stop();
+}
+
+void test_tmr_slow_hardware_pulse() {
+    IMXRT_TMR_CH_t ch{};
+    RangeTmr tmr(&ch, 19);
+    tmr.attachIsr(RangeTmr::step, FakeTmr::reset, &tmr);
+    tmr.setPulseParams(8, 19);
+    TEST_ASSERT_TRUE(tmr.usePinOutput(19));
+    tmr.stepPeriod = TS4::timerClock / 2; // 2Hz: pause longer than a counter cycle at the largest prescaler
+    tmr.start();
+    tmr.ISR(); // falling edge of the first pulse, the next step is issued a pause ahead
+    TEST_ASSERT_EQUAL_INT(2, tmr.steps);
+    TEST_ASSERT_EQUAL_UINT16(TMR_CTRL_OUTMODE(1), ch.CTRL & TMR_CTRL_OUTMODE(7)); // OFLAG held low
+
+    tmr.elapsed = 0;
+    while ((ch.CTRL & TMR_CTRL_OUTMODE(7)) == TMR_CTRL_OUTMODE(1)) tmr.phase();
+    TEST_ASSERT_EQUAL_INT(2, tmr.steps);
+    TEST_ASSERT_EQUAL_INT(0, tmr.resets);
+    TEST_ASSERT_EQUAL_UINT16(TMR_SCTRL_OEN | TMR_SCTRL_VAL | TMR_SCTRL_FORCE, ch.SCTRL); // rising edge of the second step
+    TEST_ASSERT_EQUAL_UINT16(TMR_CTRL_OUTMODE(4), ch.CTRL & TMR_CTRL_OUTMODE(7));
+    tmr.phase(); // pulse
+    TEST_ASSERT_UINT32_WITHIN(256, TS4::timerClock / 2, tmr.elapsed); // not capped at 56ms
+    TEST_ASSERT_EQUAL_INT(3, tmr.steps);
+    tmr.stop();
+}
+
+void test_tmr_fractional_period() {
+    IMXRT_TMR_CH_t ch{};
+    RangeTmr tmr(&ch);
+    tmr.attachIsr(RangeTmr::step, FakeTmr::reset, &tmr);
+
+    tmr.setPulseParams(2, 0);
+    tmr.stepPeriod = 1234; // 1234.5 ticks, fraction accumulated by the timer
+    tmr.stepFrac   = 0x8000;
+    tmr.start();
+    for (int i = 0; i < 2 * 1000; i++) tmr.phase();
+    TEST_ASSERT_EQUAL_INT(1001, tmr.steps);
+    TEST_ASSERT_UINT32_WITHIN(1, 1'234'500, tmr.elapsed);
+
+    tmr.setPulseParams(8, 0);
+    tmr.stepPeriod = 20'000'003; // /128 phases, the prescaler remainders are carried to the next pause
+    tmr.stepFrac   = 0;
+    tmr.start();
+    tmr.elapsed = 0;
+    int steps   = tmr.steps;
+    while (tmr.steps < steps + 10) tmr.phase();
+    TEST_ASSERT_UINT32_WITHIN(128, 200'000'030, tmr.elapsed);
+    tmr.stop();
+}
+
+void test_factory_spreads_modules() {
+    using namespace TS4;
+    static SimModule second; // next to the default module attached by begin()
+    TimerFactory::attachModule(&second);
+
+    ITimer* timers[8];
+    unsigned onSecond = 0;
+    for (ITimer*& t : timers) {
+        t = TimerFactory::makeTimer();
+        TEST_ASSERT_NOT_NULL(t);
+        if (t->getModule() == &second) onSecond++;
+    }
+    TEST_ASSERT_EQUAL_INT(4, onSecond);
+    TEST_ASSERT_NULL(TimerFactory::makeTimer());
+
+    TimerFactory::returnTimer(timers[5]); // goes back to its own module
+    TEST_ASSERT_EQUAL_PTR(timers[5], TimerFactory::makeTimer());
+    for (ITimer* t : timers) TimerFactory::returnTimer(t);
+    TEST_ASSERT_EQUAL_INT(4, second.freeChannels());
+    TimerFactory::detachModule(&second); // later tests see the default module only
+}
+#endif
+
 int main() {
+    TS4::begin();
     UNITY_BEGIN();
     RUN_TEST(test_pos_initialized);
+    RUN_TEST(test_intramp_follows_profile);
+    RUN_TEST(test_ramp_cache_bounded);
+#if defined(TS4_HOST)
+    RUN_TEST(test_sim_move_timing);
+    RUN_TEST(test_sim_queue_chains_moves);
+    RUN_TEST(test_sim_scurve_move);
+    RUN_TEST(test_sim_group_batched_pins);
+    RUN_TEST(test_sim_group_start_latency);
+    RUN_TEST(test_sim_group_lead_handover);
+    RUN_TEST(test_sim_group_ramp_cache);
+    RUN_TEST(test_sim_group_size_limit);
+    RUN_TEST(test_sim_dir_setup_scheduled);
+    RUN_TEST(test_sim_done_callbacks);
+    RUN_TEST(test_sim_position_events);
+    RUN_TEST(test_sim_gearing);
+    RUN_TEST(test_sim_velocity_stream);
+    RUN_TEST(test_sim_profile_tick);
+    RUN_TEST(test_sim_planner_corner_speed);
+    RUN_TEST(test_sim_group_feed_rate_arc);
+    RUN_TEST(test_sim_gcode_stream);
+    RUN_TEST(test_gcode_parser_limits);
+    RUN_TEST(test_sim_record_replay);
+#if defined(TS4_PROFILE)
+    RUN_TEST(test_sim_isr_profile);
+#endif
+    RUN_TEST(test_sim_group_stream);
+    RUN_TEST(test_tmr_hardware_pulse);
+    RUN_TEST(test_tmr_postponed_step);
+    RUN_TEST(test_tmr_auto_prescaler);
+    RUN_TEST(test_tmr_slow_hardware_pulse);
+    RUN_TEST(test_tmr_fractional_period);
+    RUN_TEST(test_factory_spreads_modules);
+#endif
     return UNITY_END();
 }